@@ -1,8 +1,31 @@
+
+#define LOG_FILE_ID 13
 #include "NewPingCWrapper.h"
 #include "NewPing.h"
 #include "global.h"
 #define MAX_DISTANCE 200
 
+// longest a timed ping can take, the echo window plus the sensor start delay
+#define ECHO_TIME_OUT ((unsigned long)(MAX_DISTANCE + 1) * US_ROUNDTRIP_CM + MAX_SENSOR_DELAY)
+
+#define ECHO_IDLE 0
+#define ECHO_WAITING 1
+#define ECHO_RECEIVED 2
+
+// the timer ISR can only call a plain function, so only one sonar
+// can be pinging at a time
+static NewPing* echo_sonar;
+static volatile char echo_state = ECHO_IDLE;
+static volatile unsigned long echo_time;
+static unsigned long echo_start_time;
+
+static void new_ping_c_wrapper_echo_check() {
+    if (echo_sonar->check_timer()) {
+        echo_time = echo_sonar->ping_result;
+        echo_state = ECHO_RECEIVED;
+    }
+}
+
 extern "C" {
 
     CNewPing * new_ping_c_wrapper_init(int trigger_pin, int echo_pin) {
@@ -17,4 +40,39 @@ extern "C" {
        LOG_PRINT(LOGGER_DEBUG, "ping value %d", value);
        return value;
     }
+
+    // sends a ping and returns straight away, the echo is timed by the
+    // Timer2 interrupt. Does nothing while the last ping is still out
+    void new_ping_c_wrapper_sonar_start(const CNewPing *new_ping) {
+       if (echo_state == ECHO_WAITING) {
+         return;
+       }
+       echo_sonar = (NewPing *)new_ping;
+       echo_state = ECHO_WAITING;
+       echo_start_time = micros();
+       echo_sonar->ping_timer(new_ping_c_wrapper_echo_check);
+    }
+
+    // returns true once the last ping has finished, with the distance in
+    // cm in value, NO_ECHO if nothing came back in time
+    char new_ping_c_wrapper_sonar_poll(const CNewPing *new_ping, int *value) {
+       switch (echo_state) {
+         case ECHO_RECEIVED:
+           *value = echo_time / US_ROUNDTRIP_CM;
+           break;
+         case ECHO_WAITING:
+           if (micros() - echo_start_time < ECHO_TIME_OUT) {
+             return false;
+           }
+           // the timer stops itself on a time out, or never started if
+           // the trigger failed
+           *value = NO_ECHO;
+           break;
+         default:
+           return false;
+       }
+       echo_state = ECHO_IDLE;
+       LOG_PRINT(LOGGER_DEBUG, "ping value %d", *value);
+       return true;
+    }
 }
@@ -9,6 +9,8 @@ extern "C" {
 
 CNewPing * new_ping_c_wrapper_init(int, int);
 int new_ping_c_wrapper_sonar_ping(const CNewPing *t);
+void new_ping_c_wrapper_sonar_start(const CNewPing *t);
+char new_ping_c_wrapper_sonar_poll(const CNewPing *t, int *value);
 #ifdef __cplusplus
 }
 #endif
@@ -4,6 +4,7 @@
  * LEDs not implelemted
  * 
  */
+#define LOG_FILE_ID 12
 #include "global.h"
 
 #ifdef __cplusplus 
@@ -11,6 +12,11 @@ extern "C" {
 #endif
   #include "actions.h"
   #include "machine.h"
+  #include "scheduler.h"
+  #include "profile.h"
+  #include "power.h"
+  #include "ram_monitor.h"
+  #include "uart.h"
 #ifdef __cplusplus 
 }
 #endif
@@ -27,18 +33,45 @@ void initialize(char*);
 void stop_machine(char*);
 void machine_reblend(char*);
 void disable_keypad(char* message);
+void calibrate_speed(char* message);
+void arm_trace(char* message);
+void dump_trace(char* message);
+
+void report_scheduler(char* message);
+void report_profile(char* message);
+void reset_profile(char* message);
+void report_outputs(char* message);
+void toggle_output(char* message);
+void report_power(char* message);
+void report_memory(char* message);
+void report_uart(char* message);
+void set_task_rates(char mode);
+
+void position_task();
+void comms_task();
+void inputs_task();
+void sonar_task();
+void motion_task();
+void heartbeat_task();
+void memory_task();
 
 hmi_message_t heartbeat_msg;
 
-long last_heartbeat;
+// tasks that slow down in low power idle
+char position_task_id;
+char sonar_task_id;
+char motion_task_id;
 
 void setup() {
   int i;
 #ifdef USB_COMMUNICATION
   // set up the serial port for communucation
-  Serial.begin(115200);
+  uart_init(115200);
 #endif
 
+  // everything below times itself from the soft timer snapshot
+  soft_timer_init();
+
   // initialize the patterns
   blend_actions_init(0);
   clean_actions_init();
@@ -55,8 +88,13 @@ void setup() {
   // initialize the logger
   logger_init();
 
-  // For the time being, explicitly initialize the machine
-  //machines[0].current_state = MACHINE_STATE_INITIALIZING;
+  // home the machine, unless the boot record says it was left at rest
+  // where it is now
+  for (i = 0; i < NUMBER_OF_MACHINES; i++) {
+    if (!machines[i].is_initialized) {
+      machine_change_state(&machines[i], MACHINE_STATE_INITIALIZING);
+    }
+  }
   
   mediator_register(MEDIATOR_AUTO_CYCLE_START, auto_cycle_start);
   mediator_register(MEDIATOR_CLEAN_CYCLE_START, clean_cycle_start);
@@ -68,61 +106,136 @@ void setup() {
   mediator_register(MEDIATOR_MOVE_UP, machine_move_up);
   mediator_register(MEDIATOR_MOVE_DOWN, machine_move_down);
   mediator_register(MEDIATOR_DISABLE_KEYPAD, disable_keypad);
+  mediator_register(MEDIATOR_CALIBRATE_SPEED, calibrate_speed);
+  mediator_register(MEDIATOR_TRACE_ARM, arm_trace);
+  mediator_register(MEDIATOR_TRACE_DUMP, dump_trace);
+  mediator_register(MEDIATOR_SCHEDULER_REPORT, report_scheduler);
+  mediator_register(MEDIATOR_PROFILE_REPORT, report_profile);
+  mediator_register(MEDIATOR_PROFILE_RESET, reset_profile);
+  mediator_register(MEDIATOR_GET_OUTPUTS, report_outputs);
+  mediator_register(MEDIATOR_TOGGLE_OUTPUT, toggle_output);
+  mediator_register(MEDIATOR_POWER_REPORT, report_power);
+  mediator_register(MEDIATOR_MEMORY_REPORT, report_memory);
+  mediator_register(MEDIATOR_UART_STATS, report_uart);
 
   heartbeat_msg.message_id = MSG_HEARTBEAT;
 
+  // the tasks run in this order on every pass
+  profile_init();
+  scheduler_init();
+  position_task_id = scheduler_add(position_task, "position", TASK_PERIOD_POSITION);
+#ifdef USB_COMMUNICATION
+  scheduler_add(comms_task, "comms", TASK_PERIOD_COMMS);
+#endif
+  scheduler_add(inputs_task, "inputs", TASK_PERIOD_INPUTS);
+  sonar_task_id = scheduler_add(sonar_task, "sonar", TASK_PERIOD_SONAR);
+  motion_task_id = scheduler_add(motion_task, "motion", TASK_PERIOD_MOTION);
+  scheduler_add(heartbeat_task, "heartbeat", TASK_PERIOD_HEARTBEAT);
+  scheduler_add(memory_task, "memory", TASK_PERIOD_MEMORY);
+  power_init(set_task_rates);
+
   LOG_PRINT(LOGGER_INFO, "Setup complete");
   
-  last_heartbeat = millis();
-  machines[0].last_step_time = millis();
+  machine_restart_step(&machines[0]);
 }
 
 void loop() {
-  int i = 0;
-#ifdef USB_COMMUNICATION
+  scheduler_run();
+  power_sleep();
+}
+
+void set_task_rates(char mode) {
+  if (mode == POWER_LOW) {
+    scheduler_set_period(position_task_id, TASK_PERIOD_POSITION_LOW);
+    scheduler_set_period(sonar_task_id, TASK_PERIOD_SONAR_LOW);
+    scheduler_set_period(motion_task_id, TASK_PERIOD_MOTION_LOW);
+  } else {
+    scheduler_set_period(position_task_id, TASK_PERIOD_POSITION);
+    scheduler_set_period(sonar_task_id, TASK_PERIOD_SONAR);
+    scheduler_set_period(motion_task_id, TASK_PERIOD_MOTION);
+  }
+}
+
+void position_task() {
+  int i;
+  for (i = 0; i < NUMBER_OF_MACHINES; i++) {
+    machine_update_position(&machines[i]);
+  }
+}
+
+void comms_task() {
+  // anything from the HMI wakes the station
+  if (uart_available()) {
+    power_wake();
+  }
   // check if there are any messages to process
   usb_communication_process();
-#endif
+  // send what was logged since the last pass
+  logger_flush();
+}
 
-  // initialize the machine
+void inputs_task() {
+  int i;
+  for (i = 0; i < NUMBER_OF_MACHINES; i++) {
+    machine_read_inputs(&machines[i]);
+    if (machine_buttons_pressed(&machines[i])) {
+      power_wake();
+    }
+  }
+}
+
+void sonar_task() {
+  int i;
+  for (i = 0; i < NUMBER_OF_MACHINES; i++) {
+    machine_read_sonar(&machines[i]);
+  }
+}
+
+void motion_task() {
+  int i;
   for (i = 0; i < NUMBER_OF_MACHINES; i++) {
     machine_check_safety_conditions(&machines[i]);
     machine_process(&machines[i]);
   } 
+  power_update(machine_at_rest(&machines[0]));
+}
 
+void heartbeat_task() {
   // send out heartbeat message
-  if (millis() > last_heartbeat + 1000) {
-    last_heartbeat = millis(); 
-    usb_communication_send_message(heartbeat_msg, 0);
-  }
+  usb_communication_send_message(heartbeat_msg, 0);
+}
+
+void memory_task() {
+  ram_monitor_check();
 }
 
-// TODO: seriously, we need to add validation to this, otherwise
-// we can change from blending to cleaning without stopping.....
+// cycles only start from idle, see machine_request_state
 void auto_cycle_start(char* args) {
   LOG_PRINT(LOGGER_INFO, "Starting auto cycle");
-  machines[0].current_state = MACHINE_STATE_BLENDING;
+  machine_request_state(&machines[0], MACHINE_STATE_BLENDING);
 }
 
 void clean_cycle_start(char*) {
   LOG_PRINT(LOGGER_INFO, "Starting clean cycle");
-  machines[0].current_state = MACHINE_STATE_CLEANING;
+  machine_request_state(&machines[0], MACHINE_STATE_CLEANING);
 }
 
 void initialize(char*){
   LOG_PRINT(LOGGER_INFO, "Initializing");
-  machines[0].current_state = MACHINE_STATE_INITIALIZING;
+  machine_request_state(&machines[0], MACHINE_STATE_INITIALIZING);
 }
 
 void stop_machine(char* args) {
   LOG_PRINT(LOGGER_INFO, "Stopping machine");
-  machines[0].current_state = MACHINE_STATE_IDLE;
+  machine_request_state(&machines[0], MACHINE_STATE_IDLE);
 }
 
 void machine_reblend(char* message){
   LOG_PRINT(LOGGER_VERBOSE, "Starting reblending");
-  blend_sequence.actions_ptr[5].activate.state = OFF;
-  machines[0].current_state = MACHINE_STATE_BLENDING;
+  // blending exit puts the recipe back
+  if (machine_request_state(&machines[0], MACHINE_STATE_BLENDING)) {
+    blend_sequence.actions_ptr[5].activate.state = OFF;
+  }
 }
 
 
@@ -133,8 +246,8 @@ void machine_jog_top(char* message){
 
 void machine_jog_bottom(char* message){
   LOG_PRINT(LOGGER_VERBOSE, "Jogging bottom");
-  digitalWrite(PUMP_ADDRESS, 0);
-  digitalWrite(CLEANING_VALVE_ADDRESS, 0);
+  outputs_write(OUTPUT_PUMP, LOW);
+  outputs_write(OUTPUT_CLEANING_VALVE, LOW);
 }
 
 void machine_move_up(char* message){
@@ -143,12 +256,66 @@ void machine_move_up(char* message){
 }
 
 void machine_move_down(char* message){
-  send_status("Moving down");
+  send_status_P(PSTR("Moving down"));
   machines[0].buttons[MOVE_DOWN].current_state = !machines[0].buttons[MOVE_DOWN].current_state;
 }
 
 void disable_keypad(char* message) {
-  send_status("Keypad toggled");
+  send_status_P(PSTR("Keypad toggled"));
   machines[0].keypad_enabled = ! machines[0].keypad_enabled;
 }
 
+void calibrate_speed(char* message) {
+  if (!machine_request_state(&machines[0], MACHINE_STATE_CALIBRATING)) {
+    send_status_P(PSTR("Speed calibration needs an idle machine"));
+    return;
+  }
+  send_status_P(PSTR("Calibrating actuator speed"));
+}
+
+// usb_comm checks the message is a whole trace_arm_t
+void arm_trace(char* message) {
+  if (!trace_arm((trace_arm_t*)message)) {
+    send_status_P(PSTR("Trace arm refused"));
+    return;
+  }
+  send_status_P(PSTR("Trace armed"));
+}
+
+void dump_trace(char* message) {
+  trace_dump();
+}
+
+void report_scheduler(char* message) {
+  scheduler_report();
+}
+
+void report_profile(char* message) {
+  profile_report();
+}
+
+void reset_profile(char* message) {
+  profile_reset();
+  send_status_P(PSTR("Profile reset"));
+}
+
+void report_outputs(char* message) {
+  outputs_report();
+}
+
+// message is the pin number
+void toggle_output(char* message) {
+  outputs_toggle_address(message[0]);
+}
+
+void report_power(char* message) {
+  power_report();
+}
+
+void report_memory(char* message) {
+  ram_monitor_report();
+}
+
+void report_uart(char* message) {
+  uart_report();
+}
@@ -1,22 +1,84 @@
+#define LOG_FILE_ID 1
 #include "actions.h"
 #include "blender.h"
 #include "machine.h"// add
 
 #define MAX_ACTIONS 150
 
+// The refill and the block of loops after it, from refill_start up to
+// stir_end. Split out so a blend that is extended can put back the steps
+// jam recovery rewrote before it runs the block again.
+static int blend_refill_actions(int i) {
+  int j;
+
+  //refill
+  blend_sequence.refill_start = i;
+  blend_sequence.actions_ptr[i].type = ACTION_ACTIVATE;
+  blend_sequence.actions_ptr[i].activate.address = LIQUID_FILLING_VALVE_ADDRESS;
+  blend_sequence.actions_ptr[i++].activate.state = ON;
+
+  blend_sequence.actions_ptr[i].type = ACTION_ACTIVATE;
+  blend_sequence.actions_ptr[i].activate.address = CLEANING_VALVE_ADDRESS;
+  blend_sequence.actions_ptr[i++].activate.state = OFF;
+
+  blend_sequence.actions_ptr[i].type = ACTION_WAIT;
+  blend_sequence.actions_ptr[i++].wait.time_to_wait = 100; //ms
+  
+  blend_sequence.actions_ptr[i].type = ACTION_ACTIVATE;
+  blend_sequence.actions_ptr[i].activate.address = PUMP_ADDRESS;
+  blend_sequence.actions_ptr[i++].activate.state = ON;
+  
+
+  blend_sequence.actions_ptr[i].type = ACTION_WAIT;
+  blend_sequence.actions_ptr[i++].wait.time_to_wait = 1000; //ms 2750
+  
+  blend_sequence.actions_ptr[i].type = ACTION_ACTIVATE;
+  blend_sequence.actions_ptr[i].activate.address = PUMP_ADDRESS;
+  blend_sequence.actions_ptr[i++].activate.state = OFF;
+
+  blend_sequence.actions_ptr[i].type = ACTION_WAIT;
+  blend_sequence.actions_ptr[i++].wait.time_to_wait = 1000; //ms
+  //
+  blend_sequence.stir_resume = i;
+   for (j = 0; j < 2; j++) {
+    blend_sequence.actions_ptr[i].type = ACTION_MTP;
+    blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP + POSITION(60); // position 595-30  TOP_OF_CUP + 15
+    blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_UP;
+    blend_sequence.actions_ptr[i].mtp.time_out = 3000;
+    blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_QUARTER; //half
+
+
+    blend_sequence.actions_ptr[i].type = ACTION_WAIT;
+    blend_sequence.actions_ptr[i++].wait.time_to_wait = 250; //ms
+    
+    blend_sequence.actions_ptr[i].type = ACTION_MTP;
+    blend_sequence.actions_ptr[i].mtp.new_position = BOTTOM_OF_CUP; // position 595+5 ,+15, BOTTOM_OF_CUP
+    blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
+    blend_sequence.actions_ptr[i].mtp.time_out = 3000;
+    blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_QUARTER;//half
+
+    blend_sequence.actions_ptr[i].type = ACTION_WAIT;
+    blend_sequence.actions_ptr[i++].wait.time_to_wait = 700; //ms 1000 2750
+    
+  }
+
+  return i;
+}
+
 void blend_actions_init(char reinit) {
-  int i, j = 0;
+  int i = 0, j = 0;
   blend_sequence.jam_counter_total = 0;
   // allocate space for actions_ptr
   if (!reinit) {
     blend_sequence.actions_ptr = (action_t*) malloc(MAX_ACTIONS * sizeof(action_t));
   }
+  memset(blend_sequence.actions_ptr, 0, MAX_ACTIONS * sizeof(action_t));
 
   // STARTING OF BLENDING SEQUENCE
   blend_sequence.actions_ptr[i].type = ACTION_WAIT_FOR;
-  blend_sequence.actions_ptr[i].wait_for.type = WAIT_FOR_CUP_IN_PLACE; // position
-  blend_sequence.actions_ptr[i].wait_for.value = 15;
-  blend_sequence.actions_ptr[i++].wait_for.comparer = WAIT_FOR_LESS_THAN;
+  blend_sequence.actions_ptr[i].wait_for.type = WAIT_FOR_CUP_STATE; // cup closer than CUP_PRESENT_DISTANCE
+  blend_sequence.actions_ptr[i].wait_for.value = 1;
+  blend_sequence.actions_ptr[i++].wait_for.comparer = WAIT_FOR_EQUALS;
 
   blend_sequence.actions_ptr[i].type = ACTION_WAIT;
   blend_sequence.actions_ptr[i++].wait.time_to_wait = 2000; //ms
@@ -46,10 +108,10 @@ void blend_actions_init(char reinit) {
 
   // 1. Move the blender to above the cup
   blend_sequence.actions_ptr[i].type = ACTION_MTP;
-  blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP + 65; // position TOP_OF_CUP+20， 35, 45
+  blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP + POSITION(65); // position TOP_OF_CUP+20， 35, 45
   blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
   blend_sequence.actions_ptr[i].mtp.time_out = 5000;
-  blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_HALF;
+  blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_FULL;
 
   blend_sequence.actions_ptr[i].type = ACTION_WAIT;
   blend_sequence.actions_ptr[i++].wait.time_to_wait = 500; //ms
@@ -84,10 +146,12 @@ void blend_actions_init(char reinit) {
  
 
   //add main blending
+  // paced through the fruit by the speed model, quarter speed at most
   blend_sequence.actions_ptr[i].type = ACTION_MTP;
   blend_sequence.actions_ptr[i].mtp.new_position = BOTTOM_OF_CUP; // position(20*J)
   blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
   blend_sequence.actions_ptr[i].mtp.time_out = 3000;
+  blend_sequence.actions_ptr[i].mtp.travel_time = 2000; //ms
   blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_QUARTER; //full
 
   blend_sequence.actions_ptr[i].type = ACTION_WAIT;
@@ -103,9 +167,10 @@ void blend_actions_init(char reinit) {
   blend_sequence.actions_ptr[i].type = ACTION_WAIT;
   blend_sequence.actions_ptr[i++].wait.time_to_wait = 250; //ms
 
+  blend_sequence.stir_start = i;
   for (j = 0; j < 4; j++) {
     blend_sequence.actions_ptr[i].type = ACTION_MTP;
-    blend_sequence.actions_ptr[i].mtp.new_position = BOTTOM_OF_CUP - 40; // position 595-30 BOTTOM_OF_CUP - 60
+    blend_sequence.actions_ptr[i].mtp.new_position = BOTTOM_OF_CUP - POSITION(40); // position 595-30 BOTTOM_OF_CUP - 60
     blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_UP;
     blend_sequence.actions_ptr[i].mtp.time_out = 3000;
     blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_FULL;
@@ -114,7 +179,7 @@ void blend_actions_init(char reinit) {
     blend_sequence.actions_ptr[i++].wait.time_to_wait = 250; //ms
     
     blend_sequence.actions_ptr[i].type = ACTION_MTP;
-    blend_sequence.actions_ptr[i].mtp.new_position = BOTTOM_OF_CUP + 10; // position 595+5  BOTTOM_OF_CUP -40,BOTTOM_OF_CUP
+    blend_sequence.actions_ptr[i].mtp.new_position = BOTTOM_OF_CUP + POSITION(10); // position 595+5  BOTTOM_OF_CUP -40,BOTTOM_OF_CUP
     blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
     blend_sequence.actions_ptr[i].mtp.time_out = 3000;
     blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_QUARTER; //full half
@@ -126,7 +191,7 @@ void blend_actions_init(char reinit) {
 
    for (j = 0; j < 2; j++) {
     blend_sequence.actions_ptr[i].type = ACTION_MTP;
-    blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP + 60; // position 595-30  TOP_OF_CUP + 15,40
+    blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP + POSITION(60); // position 595-30  TOP_OF_CUP + 15,40
     blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_UP;
     blend_sequence.actions_ptr[i].mtp.time_out = 3000;
     blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_QUARTER; //half
@@ -140,7 +205,7 @@ void blend_actions_init(char reinit) {
     blend_sequence.actions_ptr[i++].wait.time_to_wait = 250; //ms
     
     blend_sequence.actions_ptr[i].type = ACTION_MTP;
-    blend_sequence.actions_ptr[i].mtp.new_position = BOTTOM_OF_CUP + 10; // position 595+5 ,+15, BOTTOM_OF_CUP
+    blend_sequence.actions_ptr[i].mtp.new_position = BOTTOM_OF_CUP + POSITION(10); // position 595+5 ,+15, BOTTOM_OF_CUP
     blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
     blend_sequence.actions_ptr[i].mtp.time_out = 3000;
     blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_QUARTER; //half
@@ -160,7 +225,7 @@ void blend_actions_init(char reinit) {
     blend_sequence.actions_ptr[i++].wait.time_to_wait = 250; //ms   
 
     blend_sequence.actions_ptr[i].type = ACTION_MTP;
-    blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP + 20; // position 595-30  TOP_OF_CUP + 15
+    blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP + POSITION(20); // position 595-30  TOP_OF_CUP + 15
     blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_UP;
     blend_sequence.actions_ptr[i].mtp.time_out = 3000;
     blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_HALF; //half 
@@ -168,7 +233,7 @@ void blend_actions_init(char reinit) {
 
    for (j = 0; j < 2; j++) {
     blend_sequence.actions_ptr[i].type = ACTION_MTP;
-    blend_sequence.actions_ptr[i].mtp.new_position = BOTTOM_OF_CUP - 40; // position 595-30 BOTTOM_OF_CUP - 60
+    blend_sequence.actions_ptr[i].mtp.new_position = BOTTOM_OF_CUP - POSITION(40); // position 595-30 BOTTOM_OF_CUP - 60
     blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_UP;
     blend_sequence.actions_ptr[i].mtp.time_out = 3000;
     blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_QUARTER;
@@ -178,7 +243,7 @@ void blend_actions_init(char reinit) {
 
     
     blend_sequence.actions_ptr[i].type = ACTION_MTP;
-    blend_sequence.actions_ptr[i].mtp.new_position = BOTTOM_OF_CUP + 10; // position 595+5  BOTTOM_OF_CUP -40,BOTTOM_OF_CUP
+    blend_sequence.actions_ptr[i].mtp.new_position = BOTTOM_OF_CUP + POSITION(10); // position 595+5  BOTTOM_OF_CUP -40,BOTTOM_OF_CUP
     blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
     blend_sequence.actions_ptr[i].mtp.time_out = 3000;
     blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_QUARTER; //full half
@@ -195,56 +260,10 @@ void blend_actions_init(char reinit) {
     //  
   }
   
-  //refill
-  blend_sequence.actions_ptr[i].type = ACTION_ACTIVATE;
-  blend_sequence.actions_ptr[i].activate.address = LIQUID_FILLING_VALVE_ADDRESS;
-  blend_sequence.actions_ptr[i++].activate.state = ON;
-
-  blend_sequence.actions_ptr[i].type = ACTION_ACTIVATE;
-  blend_sequence.actions_ptr[i].activate.address = CLEANING_VALVE_ADDRESS;
-  blend_sequence.actions_ptr[i++].activate.state = OFF;
-
-  blend_sequence.actions_ptr[i].type = ACTION_WAIT;
-  blend_sequence.actions_ptr[i++].wait.time_to_wait = 100; //ms
-  
-  blend_sequence.actions_ptr[i].type = ACTION_ACTIVATE;
-  blend_sequence.actions_ptr[i].activate.address = PUMP_ADDRESS;
-  blend_sequence.actions_ptr[i++].activate.state = ON;
-  
-
-  blend_sequence.actions_ptr[i].type = ACTION_WAIT;
-  blend_sequence.actions_ptr[i++].wait.time_to_wait = 1000; //ms 2750
-  
-  blend_sequence.actions_ptr[i].type = ACTION_ACTIVATE;
-  blend_sequence.actions_ptr[i].activate.address = PUMP_ADDRESS;
-  blend_sequence.actions_ptr[i++].activate.state = OFF;
-
-  blend_sequence.actions_ptr[i].type = ACTION_WAIT;
-  blend_sequence.actions_ptr[i++].wait.time_to_wait = 1000; //ms
-  //
-   for (j = 0; j < 2; j++) {
-    blend_sequence.actions_ptr[i].type = ACTION_MTP;
-    blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP + 60; // position 595-30  TOP_OF_CUP + 15
-    blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_UP;
-    blend_sequence.actions_ptr[i].mtp.time_out = 3000;
-    blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_QUARTER; //half
-
-
-    blend_sequence.actions_ptr[i].type = ACTION_WAIT;
-    blend_sequence.actions_ptr[i++].wait.time_to_wait = 250; //ms
-    
-    blend_sequence.actions_ptr[i].type = ACTION_MTP;
-    blend_sequence.actions_ptr[i].mtp.new_position = BOTTOM_OF_CUP; // position 595+5 ,+15, BOTTOM_OF_CUP
-    blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
-    blend_sequence.actions_ptr[i].mtp.time_out = 3000;
-    blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_QUARTER;//half
+  i = blend_refill_actions(i);
 
-    blend_sequence.actions_ptr[i].type = ACTION_WAIT;
-    blend_sequence.actions_ptr[i++].wait.time_to_wait = 700; //ms 1000 2750
-    
-  }    
-  
   // 23. Move to top, stay in liquid
+  blend_sequence.stir_end = i;
   blend_sequence.actions_ptr[i].type = ACTION_ACTIVATE;
   blend_sequence.actions_ptr[i].activate.address = BLENDER_ADDRESS;
   blend_sequence.actions_ptr[i++].activate.state = OFF;
@@ -256,26 +275,30 @@ void blend_actions_init(char reinit) {
   blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP; // position
   blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_UP;
   blend_sequence.actions_ptr[i].mtp.time_out = 5000;
-  blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_HALF;
+  blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_FULL;
 
   blend_sequence.actions_ptr[i].type = ACTION_WAIT;
-  blend_sequence.actions_ptr[i++].wait.time_to_wait = 100; //ms
+  blend_sequence.actions_ptr[i++].wait.time_to_wait = 50; //ms 100
   
   // SHAKE OFF above smoothie
+  // the strokes are ramped with dead time on every reversal, so they need
+  // less settling around them and a stroke that takes a second is stuck
   for (j = 0; j < 7; j++) {
     blend_sequence.actions_ptr[i].type = ACTION_MTP;
-    blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP - 15; // position TOP_OF_CUP - 15, 19，-15,+5
+    blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP - POSITION(15); // position TOP_OF_CUP - 15, 19，-15,+5
     blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_UP;
-    blend_sequence.actions_ptr[i].mtp.time_out = 3000;
+    blend_sequence.actions_ptr[i].mtp.time_out = 1000; // 3000
+    blend_sequence.actions_ptr[i].mtp.ramp = BLENDER_RAMP_SHAKE_OFF;
     blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_FULL;
 
     //blend_sequence.actions_ptr[i].type = ACTION_WAIT;
     //blend_sequence.actions_ptr[i++].wait.time_to_wait = 250; //ms
     
     blend_sequence.actions_ptr[i].type = ACTION_MTP;
-    blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP - 5; // position TOP_OF_CUP-10, 14，-10,+10
+    blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP - POSITION(5); // position TOP_OF_CUP-10, 14，-10,+10
     blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
-    blend_sequence.actions_ptr[i].mtp.time_out = 3000;
+    blend_sequence.actions_ptr[i].mtp.time_out = 1000; // 3000
+    blend_sequence.actions_ptr[i].mtp.ramp = BLENDER_RAMP_SHAKE_OFF;
     blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_FULL;
 
     //blend_sequence.actions_ptr[i].type = ACTION_WAIT;
@@ -284,7 +307,7 @@ void blend_actions_init(char reinit) {
 
   // 24. Turn blender off
   blend_sequence.actions_ptr[i].type = ACTION_WAIT;
-  blend_sequence.actions_ptr[i++].wait.time_to_wait = 100; //ms
+  blend_sequence.actions_ptr[i++].wait.time_to_wait = 50; //ms 100
 
   //blend_sequence.actions_ptr[i].type = ACTION_ACTIVATE;
   //blend_sequence.actions_ptr[i].activate.address = BLENDER_ADDRESS;
@@ -294,7 +317,7 @@ void blend_actions_init(char reinit) {
   //blend_sequence.actions_ptr[i++].wait.time_to_wait = 1400; //ms
 
   blend_sequence.actions_ptr[i].type = ACTION_MTP;
-  blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP - 30; // position TOP_OF_CUP - 20
+  blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP - POSITION(30); // position TOP_OF_CUP - 20
   blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_UP;
   blend_sequence.actions_ptr[i].mtp.time_out = 3000;
   blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_FULL;
@@ -303,18 +326,20 @@ void blend_actions_init(char reinit) {
   // SHAKE OFF above top
   for (j = 0; j < 7; j++) {
     blend_sequence.actions_ptr[i].type = ACTION_MTP;
-    blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP - 35; // position TOP_OF_CUP - 20
+    blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP - POSITION(35); // position TOP_OF_CUP - 20
     blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_UP;
-    blend_sequence.actions_ptr[i].mtp.time_out = 3000;
+    blend_sequence.actions_ptr[i].mtp.time_out = 1000; // 3000
+    blend_sequence.actions_ptr[i].mtp.ramp = BLENDER_RAMP_SHAKE_OFF;
     blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_FULL;
 
     //blend_sequence.actions_ptr[i].type = ACTION_WAIT;
     //blend_sequence.actions_ptr[i++].wait.time_to_wait = 250; //ms
     
     blend_sequence.actions_ptr[i].type = ACTION_MTP;
-    blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP - 25; // position TOP_OF_CUP
+    blend_sequence.actions_ptr[i].mtp.new_position = TOP_OF_CUP - POSITION(25); // position TOP_OF_CUP
     blend_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
-    blend_sequence.actions_ptr[i].mtp.time_out = 3000;
+    blend_sequence.actions_ptr[i].mtp.time_out = 1000; // 3000
+    blend_sequence.actions_ptr[i].mtp.ramp = BLENDER_RAMP_SHAKE_OFF;
     blend_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_FULL;
 
     //blend_sequence.actions_ptr[i].type = ACTION_WAIT;
@@ -346,15 +371,24 @@ void blend_actions_init(char reinit) {
   blend_sequence.jam_counter_total = 0;
 }
 
+// Rebuilds refill_start..stir_end from the recipe, jam recovery rewrites
+// up to 4 steps before the step that jammed in place
+void blend_refill_actions_init() {
+  memset(&blend_sequence.actions_ptr[blend_sequence.refill_start], 0,
+         (blend_sequence.stir_end - blend_sequence.refill_start) * sizeof(action_t));
+  blend_refill_actions(blend_sequence.refill_start);
+}
+
 void clean_actions_init() {
-  int i, j = 0;
+  int i = 0, j = 0;
   
   clean_sequence.actions_ptr = (action_t*) malloc(50 * sizeof(action_t));
+  memset(clean_sequence.actions_ptr, 0, 50 * sizeof(action_t));
   
   clean_sequence.actions_ptr[i].type = ACTION_WAIT_FOR;
-  clean_sequence.actions_ptr[i].wait_for.type = WAIT_FOR_CUP_IN_PLACE; // position
-  clean_sequence.actions_ptr[i].wait_for.value = 18;
-  clean_sequence.actions_ptr[i++].wait_for.comparer = WAIT_FOR_GREATER_THAN;
+  clean_sequence.actions_ptr[i].wait_for.type = WAIT_FOR_CUP_STATE; // cup further than CUP_ABSENT_DISTANCE
+  clean_sequence.actions_ptr[i].wait_for.value = 0;
+  clean_sequence.actions_ptr[i++].wait_for.comparer = WAIT_FOR_EQUALS;
 
   clean_sequence.actions_ptr[i].type = ACTION_WAIT;
   clean_sequence.actions_ptr[i++].wait.time_to_wait = 2000; //ms
@@ -365,7 +399,7 @@ void clean_actions_init() {
   clean_sequence.actions_ptr[i].mtp.new_position = BOTTOM_OF_CLEANING ; // position really bottom
   clean_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
   clean_sequence.actions_ptr[i].mtp.time_out = 5000;
-  clean_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_HALF;
+  clean_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_FULL;
 
   //ONLY turn the top valve
   clean_sequence.actions_ptr[i].type = ACTION_ACTIVATE;
@@ -422,10 +456,10 @@ void clean_actions_init() {
   clean_sequence.actions_ptr[i++].activate.state = OFF; 
 
   clean_sequence.actions_ptr[i].type = ACTION_MTP;
-  clean_sequence.actions_ptr[i].mtp.new_position = CLEANING_LEVEL - 20;//at the surface of plastic 555
+  clean_sequence.actions_ptr[i].mtp.new_position = CLEANING_LEVEL - POSITION(20);//at the surface of plastic 555
   clean_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_UP;
   clean_sequence.actions_ptr[i].mtp.time_out = 5000;
-  clean_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_HALF;
+  clean_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_FULL;
 
   
   
@@ -484,7 +518,7 @@ void clean_actions_init() {
   // add shake of as above here because when the blender goes up, there is still water driping from blade
   /*for (j = 0; j < 5; j++) {
     clean_sequence.actions_ptr[i].type = ACTION_MTP;
-    clean_sequence.actions_ptr[i].mtp.new_position = CLEANING_LEVEL - 30; // position
+    clean_sequence.actions_ptr[i].mtp.new_position = CLEANING_LEVEL - POSITION(30); // position
     clean_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_UP;
     clean_sequence.actions_ptr[i].mtp.time_out = 3000;
     clean_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_FULL;
@@ -493,7 +527,7 @@ void clean_actions_init() {
     clean_sequence.actions_ptr[i++].wait.time_to_wait = 250; //ms
     
     clean_sequence.actions_ptr[i].type = ACTION_MTP;
-    clean_sequence.actions_ptr[i].mtp.new_position = CLEANING_LEVEL+10; // position
+    clean_sequence.actions_ptr[i].mtp.new_position = CLEANING_LEVEL + POSITION(10); // position
     clean_sequence.actions_ptr[i].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
     clean_sequence.actions_ptr[i].mtp.time_out = 3000;
     clean_sequence.actions_ptr[i++].mtp.speed = MOTOR_SPEED_FULL;
@@ -16,6 +16,7 @@
 #define MOTOR_SPEED_QUARTER (MOTOR_SPEED_FULL / 4)
 
 #define WAIT_FOR_CUP_IN_PLACE 0
+#define WAIT_FOR_CUP_STATE 1 // value 1 waits for a cup, 0 for no cup
 
 #define WAIT_FOR_LESS_THAN 0 
 #define WAIT_FOR_GREATER_THAN 1
@@ -30,6 +31,10 @@ typedef struct __attribute__((__packed__, aligned(1))) {
   char speed;
   /* How long to try before giving up */
   int time_out;
+  /* How long the move should take (ms), 0 to use speed as is */
+  int travel_time;
+  /* PWM counts per ms to ramp up with, 0 for the default ramp */
+  unsigned char ramp;
 } action_move_to_position_t;
 
 typedef struct __attribute__((__packed__, aligned(1))) {
@@ -63,9 +68,9 @@ typedef struct __attribute__((__packed__, aligned(1))) {
   /* internal variable to track number of times repeated */
   char current_cycle;
   /* internal variable first or second step */
-  char current_step;
+  unsigned char current_step;
   /* internal variable to track where we started */
-  char start_position;
+  int start_position;
   /* internal variable to see if we have started */
   char is_running;
 } action_agitate_t;
@@ -85,6 +90,11 @@ typedef struct __attribute__((__packed__, aligned(1))) {
   action_t* actions_ptr;
   int total_actions;
   int jam_counter_total; //add
+  /* stir/lift loop blocks the blend may end early, see machine_adapt_blend */
+  int stir_start;
+  int refill_start;
+  int stir_resume;
+  int stir_end;
 } sequence_t;
 
 sequence_t blend_sequence;
@@ -94,6 +104,7 @@ sequence_t clean_sequence;
 action_t initializing_action;
 
 void blend_actions_init(char reinit);
+void blend_refill_actions_init();
 void clean_actions_init();
 void initializing_action_init();
 
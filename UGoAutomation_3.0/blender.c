@@ -1,104 +1,250 @@
+#define LOG_FILE_ID 2
 #include "blender.h"
+#include "speed_model.h"
+#include "position_adc.h"
 
-#define number_of_readings 25
+// averaged over decimated outputs, 8 x 4092 still fits the int total
+#define number_of_readings 8
 
 typedef struct {
-  int readings[number_of_readings];      // the readings from the analog input
+  int readings[number_of_readings];      // the readings from the position ADC
   int readIndex;              // the index of the current reading
   int total;                  // the running total
   int average;                // the average
+  unsigned char last_count;   // position_adc_count of the last reading taken
 } blender_position_smoother_t;
 
 blender_position_smoother_t blender_smoother;
 
+typedef struct {
+  int start;                  // the zone runs from here down to the next one
+  unsigned char max_down;
+  unsigned char max_up;
+} blender_zone_t;
+
+// fastest speed allowed at each position, so recipes can ask for full
+// speed and only get slowed where it matters
+#define BLENDER_ZONES 4
+// where the blade meets the fruit, measured up from the bottom of the cup.
+// TOP_OF_SMOOTHIE is a recipe target and sits only POSITION(5) under the
+// rim on the 4" station, which would leave no rim zone at all
+#define BLENDER_SMOOTHIE_SURFACE (BOTTOM_OF_CUP - POSITION(90))
+static const blender_zone_t blender_zones[BLENDER_ZONES] = {
+  // above the cup, nothing to hit
+  { 0, MOTOR_SPEED_FULL, MOTOR_SPEED_FULL },
+  // inside the cup, entering fast splashes and leaving the smoothie fast
+  // flings it over the rim. The stir lifts below stay at full speed
+  { TOP_OF_CUP, MOTOR_SPEED_HALF, MOTOR_SPEED_HALF },
+  // blend zone, the blade is in the fruit
+  { BLENDER_SMOOTHIE_SURFACE, MOTOR_SPEED_HALF, MOTOR_SPEED_FULL },
+  // clean zone, below the cup down to the end stop
+  { BOTTOM_OF_CUP + POSITION(20), MOTOR_SPEED_THIRD, MOTOR_SPEED_FULL }
+};
+
 void blender_init(blender_t* blender){
+  unsigned long start_time;
+
   blender->position = 0;
+  blender->velocity = 0;
+  blender->velocity_sample = 0;
+  blender->last_velocity_position = 0;
+  blender->last_velocity_time = soft_timer_now();
   blender->movement = BLENDER_MOVEMENT_IDLE;  
+  blender->speed = 0;
+  blender->move_speed = 0;
+  blender->move_start_time = 0;
+  blender->drive_direction = BLENDER_MOVEMENT_IDLE;
+  blender->duty = 0;
+  blender->ramp = BLENDER_RAMP_DEFAULT;
+  blender->last_drive_time = soft_timer_now();
+  blender->stop_time = soft_timer_now();
+  blender->stroke_start_time = 0;
   blender->blade = BLENDER_OFF;
   blender->water_pump = PUMP_OFF;
-  blender->actuator_up_address = 3;
-  blender->actuator_down_address = 4;
-  blender->blender_ssr_address = BLENDER_ADDRESS;
-  blender->water_pump_address = PUMP_ADDRESS; 
-  blender->encoder_address = A2;
-  blender->actuator_up_enabled_address = 7;
-  blender->actuator_down_enabled_address = 8;
-  blender->blender_speed_address = BLENDER_SPEED_ADDRESS;
-  blender->liquid_filling_valve_address = LIQUID_FILLING_VALVE_ADDRESS;
-  blender->cleaning_valve_address = CLEANING_VALVE_ADDRESS;
-  pinMode(blender->actuator_up_address, OUTPUT);
-  pinMode(blender->actuator_down_address, OUTPUT);
-  pinMode(blender->blender_ssr_address, OUTPUT);
-  pinMode(blender->water_pump_address, OUTPUT);
-  pinMode(blender->actuator_up_enabled_address, OUTPUT);
-  pinMode(blender->actuator_down_enabled_address, OUTPUT);
-  pinMode(blender->liquid_filling_valve_address, OUTPUT);
-  pinMode(blender->cleaning_valve_address, OUTPUT);
-  pinMode(blender->blender_speed_address, OUTPUT);
   // for now we are going to activate motor enabled. later on we
   // will check safety and activated as needed
-  digitalWrite(blender->actuator_up_enabled_address, ON);
-  digitalWrite(blender->actuator_down_enabled_address, ON);
-  
-  digitalWrite(blender->water_pump_address, ON);
-  digitalWrite(blender->liquid_filling_valve_address, ON);
-  digitalWrite(blender->cleaning_valve_address, ON);
-  digitalWrite(blender->blender_speed_address, ON);
+  outputs_init();
+
+  // start oversampling the position pot and fill the smoother with the
+  // first output so the position is valid straight away
+  position_adc_init(ENCODER_CHANNEL);
+  blender_smoother.last_count = position_adc_count();
+  // the soft timer snapshot does not move during setup, so this waits
+  // on millis itself
+  start_time = millis();
+  while (position_adc_count() == blender_smoother.last_count && millis() - start_time < 10) {
+  }
+  blender_smoother.last_count = position_adc_count();
+  blender->position = position_adc_read();
+  blender->last_velocity_position = blender->position;
 
   for (int thisReading = 0; thisReading < number_of_readings; thisReading++) {
-    blender_smoother.readings[thisReading] = 0;
+    blender_smoother.readings[thisReading] = blender->position;
   }
+  blender_smoother.readIndex = 0;
+  blender_smoother.total = blender->position * number_of_readings;
 }
 
-void blender_move(blender_t* blender, char direction, char speed){
-  blender->movement = direction;
-  
-  switch (direction) {
+// writes the current duty to the H-bridge side for the drive direction
+static void blender_write_drive(blender_t* blender) {
+  switch (blender->drive_direction) {
     case BLENDER_MOVEMENT_DOWN:
-      analogWrite(blender->actuator_down_address, 0);   
-      analogWrite(blender->actuator_up_address, speed);
+      outputs_write(OUTPUT_ACTUATOR_DOWN, 0);   
+      outputs_write(OUTPUT_ACTUATOR_UP, blender->duty);
     break;
     case BLENDER_MOVEMENT_UP:
-      analogWrite(blender->actuator_up_address, 0);
-      analogWrite(blender->actuator_down_address, speed);
+      outputs_write(OUTPUT_ACTUATOR_UP, 0);
+      outputs_write(OUTPUT_ACTUATOR_DOWN, blender->duty);
     break;
     case BLENDER_MOVEMENT_IDLE:
-      analogWrite(blender->actuator_up_address, 0);
-      analogWrite(blender->actuator_down_address, 0);
+      outputs_write(OUTPUT_ACTUATOR_UP, 0);
+      outputs_write(OUTPUT_ACTUATOR_DOWN, 0);
     break;
   }
 }
 
+void blender_move(blender_t* blender, char direction, char speed){
+  blender_move_ramped(blender, direction, speed, BLENDER_RAMP_DEFAULT);
+}
+
+// sets the movement the drive shaper works towards. Stops are never shaped
+// so moves still end where they should, starts and reversals are ramped
+void blender_move_ramped(blender_t* blender, char direction, char speed, unsigned char ramp){
+  blender->movement = direction;
+  blender->speed = (direction == BLENDER_MOVEMENT_IDLE) ? 0 : speed;
+  blender->ramp = ramp ? ramp : BLENDER_RAMP_DEFAULT;
+
+  if (direction == BLENDER_MOVEMENT_IDLE) {
+    if (blender->drive_direction != BLENDER_MOVEMENT_IDLE) {
+      blender->stop_time = soft_timer_now();
+    }
+    blender->drive_direction = BLENDER_MOVEMENT_IDLE;
+    blender->duty = 0;
+    blender_write_drive(blender);
+    return;
+  }
+
+  blender_drive(blender);
+}
+
+// non-blocking drive shaper, call every loop. On a reversal both sides of the
+// H-bridge are held off for BLENDER_DEAD_TIME, then the duty ramps up to the
+// requested speed at the move's ramp rate
+void blender_drive(blender_t* blender) {
+  unsigned long now = soft_timer_now();
+  unsigned long step;
+
+  if (blender->movement == BLENDER_MOVEMENT_IDLE) {
+    return;
+  }
+
+  if (blender->drive_direction != blender->movement) {
+    if (blender->drive_direction != BLENDER_MOVEMENT_IDLE) {
+      blender->drive_direction = BLENDER_MOVEMENT_IDLE;
+      blender->duty = 0;
+      blender->stop_time = now;
+      blender_write_drive(blender);
+    }
+
+    if (now - blender->stop_time < BLENDER_DEAD_TIME) {
+      return;
+    }
+
+    blender->drive_direction = blender->movement;
+    blender->last_drive_time = now;
+    // start on the first ramp step rather than waiting a tick at 0
+    step = blender->ramp;
+  } else {
+    step = (now - blender->last_drive_time) * blender->ramp;
+  }
+
+  if (blender->duty == blender->speed || step == 0) {
+    return;
+  }
+
+  if (blender->ramp == BLENDER_RAMP_NONE || blender->duty > blender->speed || blender->speed - blender->duty <= step) {
+    blender->duty = blender->speed;
+  } else {
+    blender->duty += step;
+  }
+
+  blender->last_drive_time = now;
+  blender_write_drive(blender);
+}
+
 void update_current_position(blender_t* blender) {
+  // only take new outputs from the position ADC
+  if (position_adc_count() != blender_smoother.last_count) {
+    blender_smoother.last_count = position_adc_count();
     // subtract the last reading:
-  blender_smoother.total = blender_smoother.total - blender_smoother.readings[blender_smoother.readIndex];
-  // read from the sensor:
-  blender_smoother.readings[blender_smoother.readIndex] = analogRead(blender->encoder_address);
-  // add the reading to the total:
-  blender_smoother.total = blender_smoother.total + blender_smoother.readings[blender_smoother.readIndex];
-  // advance to the next position in the array:
-  blender_smoother.readIndex = blender_smoother.readIndex + 1;
-
-  // if we're at the end of the array...
-  if (blender_smoother.readIndex >= number_of_readings) {
-    // ...wrap around to the beginning:
-    blender_smoother.readIndex = 0;
-  }
+    blender_smoother.total = blender_smoother.total - blender_smoother.readings[blender_smoother.readIndex];
+    // read from the sensor:
+    blender_smoother.readings[blender_smoother.readIndex] = position_adc_read();
+    // add the reading to the total:
+    blender_smoother.total = blender_smoother.total + blender_smoother.readings[blender_smoother.readIndex];
+    // advance to the next position in the array:
+    blender_smoother.readIndex = blender_smoother.readIndex + 1;
+
+    // if we're at the end of the array...
+    if (blender_smoother.readIndex >= number_of_readings) {
+      // ...wrap around to the beginning:
+      blender_smoother.readIndex = 0;
+    }
   
-  blender->position = blender_smoother.total / number_of_readings;
+    blender->position = blender_smoother.total / number_of_readings;
+  }
+
+  // sample the velocity at a fixed interval and low pass it
+  if (soft_timer_now() - blender->last_velocity_time >= BLENDER_VELOCITY_SAMPLE_TIME) {
+    int velocity = (long)(blender->position - blender->last_velocity_position) * 1000 / (long)(soft_timer_now() - blender->last_velocity_time);
+    blender->velocity += (velocity - blender->velocity) / 2;
+    blender->velocity_sample++;
+    blender->last_velocity_position = blender->position;
+    blender->last_velocity_time = soft_timer_now();
+  }
 }
 
-char move_to_position(blender_t* blender, unsigned long start_time, action_move_to_position_t* action_move_to_position) {
+// looks up the fastest the actuator may move at a position
+static unsigned char blender_zone_speed(int position, char direction) {
+  int i = BLENDER_ZONES - 1;
+
+  while (i > 0 && position < blender_zones[i].start) {
+    i--;
+  }
+  return (direction == BLENDER_MOVEMENT_DOWN) ? blender_zones[i].max_down : blender_zones[i].max_up;
+}
+
+// start_time tells moves apart, the step timer is started on the first
+// call of a move and runs out after time_out
+char move_to_position(blender_t* blender, unsigned long start_time, soft_timer_t* step_timer, action_move_to_position_t* action_move_to_position) {
+  unsigned char speed;
+
   update_current_position(blender);
 
-  // make sure we are actually moving
-  if (blender->movement != action_move_to_position->move_direction) {
+  // pick the speed once when the move starts
+  if (blender->movement != action_move_to_position->move_direction || blender->move_start_time != start_time) {
+    blender->move_start_time = start_time;
+    blender->move_speed = speed_model_select_speed(action_move_to_position->move_direction,
+      action_move_to_position->new_position - blender->position,
+      action_move_to_position->travel_time,
+      action_move_to_position->speed);
     LOG_PRINT(LOGGER_VERBOSE, "Activating the motor to move %s", action_move_to_position->move_direction == BLENDER_MOVEMENT_DOWN ? "down" : "up");
-    blender_move(blender, action_move_to_position->move_direction, action_move_to_position->speed);
+  }
+
+  // then hold it under the limit of the zone the actuator is in
+  speed = blender_zone_speed(blender->position, action_move_to_position->move_direction);
+  if (blender->move_speed < speed) {
+    speed = blender->move_speed;
+  }
+  if (blender->movement != action_move_to_position->move_direction || blender->speed != speed) {
+    blender_move_ramped(blender, action_move_to_position->move_direction, speed, action_move_to_position->ramp);
   }
 
   // add a timeout in case it gets jammed  // time_out bigger means when jam detected, the actuator will react faster
-  if (start_time + (action_move_to_position->time_out) < millis()) { //(start_time + action_move_to_position->time_out < millis()) {
+  if (step_timer && step_timer->state == SOFT_TIMER_IDLE) {
+    soft_timer_start(step_timer, action_move_to_position->time_out, NULL);
+  }
+  if (step_timer && soft_timer_expired(step_timer)) {
     LOG_PRINT(LOGGER_VERBOSE, "Movement timeout");
     return true;
   }
@@ -132,52 +278,54 @@ char move_to_position(blender_t* blender, unsigned long start_time, action_move_
   }
 }
 
-char wait(blender_t* blender, unsigned long start_wait_time, action_wait_t* action_wait) {
-  return ((start_wait_time + action_wait->time_to_wait) < millis());
+char wait(blender_t* blender, soft_timer_t* step_timer, action_wait_t* action_wait) {
+  if (step_timer->state == SOFT_TIMER_IDLE) {
+    soft_timer_start(step_timer, action_wait->time_to_wait, NULL);
+  }
+  return soft_timer_expired(step_timer);
 }
 
 char activate(blender_t* blender, action_activate_t* action_activate) {
   if (action_activate->address == BLENDER_ADDRESS) {
-    digitalWrite(action_activate->address, action_activate->state);
+    outputs_write_address(action_activate->address, action_activate->state);
   } else {
-    digitalWrite(action_activate->address, !action_activate->state);
+    outputs_write_address(action_activate->address, !action_activate->state);
   }
   return 1;
 }
 
-char agitate(blender_t* blender_ptr, action_agitate_t* action_agitate) {
+// every stroke is its own move, timed from when it starts by the step timer
+char agitate(blender_t* blender_ptr, soft_timer_t* step_timer, action_agitate_t* action_agitate) {
   // agitate is a series of move_to_positions, this is where we set it up
-  LOG_PRINT(LOGGER_ERROR, "Agitating");
-  action_move_to_position_t* action_move_to_position_ptr;
+  action_move_to_position_t stroke;
 
   if(!action_agitate->is_running) {
+    LOG_PRINT(LOGGER_VERBOSE, "Agitating");
     action_agitate->is_running = 1;
     action_agitate->start_position = blender_ptr->position;
+    blender_ptr->stroke_start_time = soft_timer_now();
+    soft_timer_stop(step_timer);
   }
-  
+
+  stroke.speed = MOTOR_SPEED_FULL;
+  stroke.time_out = 5000;
+  stroke.travel_time = 0;
+  stroke.ramp = 0;
   if ((!action_agitate->current_step && action_agitate->start_direction) || (action_agitate->current_step && !action_agitate->start_direction)) {
-    
-  LOG_PRINT(LOGGER_ERROR, "DOWN");
     // LOWER
-    action_move_to_position_ptr->new_position = action_agitate->start_position + action_agitate->lowering_distance ;
-    action_move_to_position_ptr->move_direction = BLENDER_MOVEMENT_DOWN;
-    action_move_to_position_ptr->speed = MOTOR_SPEED_FULL;
-    action_move_to_position_ptr->time_out = 5000;
+    stroke.new_position = action_agitate->start_position + POSITION(action_agitate->lowering_distance);
+    stroke.move_direction = BLENDER_MOVEMENT_DOWN;
   } else {
-    
-  LOG_PRINT(LOGGER_ERROR, "UP");
     // RAISE
-    action_move_to_position_ptr->new_position = action_agitate->start_position - action_agitate->rising_distance ;
-    action_move_to_position_ptr->move_direction = BLENDER_MOVEMENT_UP;
-    action_move_to_position_ptr->speed = MOTOR_SPEED_FULL;
-    action_move_to_position_ptr->time_out = 5000;
+    stroke.new_position = action_agitate->start_position - POSITION(action_agitate->rising_distance);
+    stroke.move_direction = BLENDER_MOVEMENT_UP;
   }
 
-  if (move_to_position(blender_ptr, millis(), action_move_to_position_ptr)) {
-    // we are in the right position
-    
-  LOG_PRINT(LOGGER_ERROR, "MTP DONE");
+  if (move_to_position(blender_ptr, blender_ptr->stroke_start_time, step_timer, &stroke)) {
+    // we are in the right position, the next stroke starts from here
     action_agitate->start_position = blender_ptr->position;
+    blender_ptr->stroke_start_time = soft_timer_now();
+    soft_timer_stop(step_timer);
     
     if (action_agitate->current_step) {
       action_agitate->current_cycle++;
@@ -3,6 +3,8 @@
 
 #include "global.h"
 #include "actions.h"
+#include "outputs.h"
+#include "soft_timer.h"
 
 #define BLENDER_MOVEMENT_DOWN 0
 #define BLENDER_MOVEMENT_UP 1
@@ -14,39 +16,51 @@
 #define PUMP_ON 1
 #define PUMP_OFF 0
 
-#define BLENDER_ADDRESS 9
-#define PUMP_ADDRESS 51
-#define LIQUID_FILLING_VALVE_ADDRESS 49
-#define CLEANING_VALVE_ADDRESS 53
-#define BLENDER_SPEED_ADDRESS 35
+#define BLENDER_VELOCITY_SAMPLE_TIME 50 // ms
+
+// drive shaping, the ramp is in PWM counts per ms
+#define BLENDER_RAMP_DEFAULT 8
+#define BLENDER_RAMP_SHAKE_OFF 32 // full duty in 8 ms for the short shake off strokes
+#define BLENDER_RAMP_NONE 0xFF
+#define BLENDER_DEAD_TIME 10 // ms both sides are off when reversing
 
 
 typedef struct{
   int position;
+  /* filtered velocity in counts per second, positive is down */
+  int velocity;
+  /* incremented every time a new velocity sample is taken */
+  unsigned char velocity_sample;
+  int last_velocity_position;
+  unsigned long last_velocity_time;
   char movement;  
+  unsigned char speed;
+  /* speed the running move asked for, before the zone limits */
+  unsigned char move_speed;
+  unsigned long move_start_time;
+  /* what the H-bridge is actually driven with, see blender_drive */
+  char drive_direction;
+  unsigned char duty;
+  unsigned char ramp;
+  unsigned long last_drive_time;
+  unsigned long stop_time;
+  /* when the running agitate stroke started, tells strokes apart */
+  unsigned long stroke_start_time;
   char blade;
   char water_pump;
-  int actuator_up_address;
-  int actuator_down_address;
-  int blender_ssr_address;
-  int water_pump_address;
-  int encoder_address; 
-  int actuator_up_enabled_address;
-  int actuator_down_enabled_address;
-  int liquid_filling_valve_address;
-  int cleaning_valve_address;
   char blender_speed;  
-  char blender_speed_address;
 } blender_t;
 
 void blender_init(blender_t*);
 void blender_move(blender_t*, char, char);
+void blender_move_ramped(blender_t*, char, char, unsigned char);
+void blender_drive(blender_t*);
 void update_current_position(blender_t*);
 
-char move_to_position(blender_t*, unsigned long, action_move_to_position_t*);
-char wait(blender_t*, unsigned long, action_wait_t*);
+char move_to_position(blender_t*, unsigned long, soft_timer_t*, action_move_to_position_t*);
+char wait(blender_t*, soft_timer_t*, action_wait_t*);
 char activate(blender_t*, action_activate_t*);
-char agitate(blender_t*, action_agitate_t*);
+char agitate(blender_t*, soft_timer_t*, action_agitate_t*);
 
 #endif
 
@@ -0,0 +1,129 @@
+/***************************************************
+  Boot Record                        <boot_record.c>
+
+  Keeps the last position the actuator came to rest
+  at in EEPROM, with a flag that is cleared whenever
+  it starts moving. If the power goes while the
+  actuator is still, the flag is set at the next boot
+  and the saved position can be checked against the
+  pot to skip homing.
+
+  A record is written when a cycle or a jog starts
+  and again once the actuator has settled, about two
+  per cycle. Each goes to the next of
+  BOOT_RECORD_SLOTS slots with a sequence number, so
+  one slot is written every eight cycles or so and
+  the EEPROM outlasts the actuator.
+***************************************************/
+#define LOG_FILE_ID 3
+#include "boot_record.h"
+#include "soft_timer.h"
+#include <avr/eeprom.h>
+
+static boot_record_t boot_record;
+static unsigned char boot_record_slot;
+static unsigned long boot_record_rest_time;
+
+#define BOOT_RECORD_EEPROM ((boot_record_eeprom_t*)EEPROM_BOOT_RECORD_ADDRESS)
+
+// writes boot_record to the slot after the newest, the sequence goes last
+// so a power loss part way through leaves the newest slot as it was
+static void boot_record_write() {
+  boot_record_t* slot;
+
+  boot_record_slot = (boot_record_slot + 1) % BOOT_RECORD_SLOTS;
+  slot = &BOOT_RECORD_EEPROM->slots[boot_record_slot];
+  boot_record.sequence++;
+  eeprom_update_byte((uint8_t*)&slot->clean_shutdown, boot_record.clean_shutdown);
+  eeprom_update_block(&boot_record.position, &slot->position, sizeof(boot_record.position));
+  eeprom_update_byte(&slot->sequence, boot_record.sequence);
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  boot_record_init                   <boot_record.c>
+
+  SYNTAX: char boot_record_init( int position );
+
+  DESCRIPTION:
+  Loads the boot record and checks it against the
+  live position reading.
+
+  PARAMETER1: The position read from the pot at boot
+
+  RETURN VALUE:  true if the machine was shut down
+                 at rest where it is now
+  END DESCRIPTION ***********************************/
+char boot_record_init(int position) {
+  boot_record_t slot;
+  unsigned char i;
+
+  boot_record_rest_time = soft_timer_now();
+
+  if (eeprom_read_byte((uint8_t*)&BOOT_RECORD_EEPROM->version) != BOOT_RECORD_VERSION) {
+    // number the slots in order so the last one reads as the newest
+    boot_record.clean_shutdown = 0;
+    boot_record.position = position;
+    for (i = 0; i < BOOT_RECORD_SLOTS; i++) {
+      boot_record.sequence = i;
+      eeprom_update_block(&boot_record, &BOOT_RECORD_EEPROM->slots[i], sizeof(boot_record));
+    }
+    boot_record_slot = BOOT_RECORD_SLOTS - 1;
+    eeprom_update_byte((uint8_t*)&BOOT_RECORD_EEPROM->version, BOOT_RECORD_VERSION);
+    return false;
+  }
+
+  // the newest slot is the last one whose sequence the next slot follows on
+  eeprom_read_block(&boot_record, &BOOT_RECORD_EEPROM->slots[0], sizeof(boot_record));
+  boot_record_slot = 0;
+  for (i = 1; i < BOOT_RECORD_SLOTS; i++) {
+    eeprom_read_block(&slot, &BOOT_RECORD_EEPROM->slots[i], sizeof(slot));
+    if (slot.sequence != (unsigned char)(boot_record.sequence + 1)) {
+      break;
+    }
+    boot_record = slot;
+    boot_record_slot = i;
+  }
+
+  LOG_PRINT(LOGGER_INFO, "Boot record clean:%d saved:%d now:%d", boot_record.clean_shutdown, boot_record.position, position);
+  return boot_record.clean_shutdown && abs(position - boot_record.position) <= BOOT_RECORD_TOLERANCE;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  boot_record_update                 <boot_record.c>
+
+  SYNTAX: void boot_record_update( char at_rest, int position );
+
+  DESCRIPTION:
+  Call every loop. Clears the clean flag as soon as
+  the actuator is no longer at rest, and saves the
+  position with the flag set once it has been at
+  rest long enough. Each change is a new slot, see
+  boot_record_write.
+
+  PARAMETER1: true if nothing is moving
+  PARAMETER2: The current position
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void boot_record_update(char at_rest, int position) {
+  if (!at_rest) {
+    boot_record_rest_time = soft_timer_now();
+    if (boot_record.clean_shutdown) {
+      boot_record.clean_shutdown = 0;
+      boot_record_write();
+    }
+    return;
+  }
+
+  if (soft_timer_now() - boot_record_rest_time < BOOT_RECORD_SETTLE_TIME) {
+    return;
+  }
+
+  if (boot_record.clean_shutdown && abs(position - boot_record.position) <= POSITION(2)) {
+    return;
+  }
+
+  boot_record.position = position;
+  boot_record.clean_shutdown = 1;
+  boot_record_write();
+}
@@ -0,0 +1,32 @@
+#ifndef BOOT_RECORD_H
+#define BOOT_RECORD_H
+
+#include "global.h"
+
+// how far the live reading may be from the saved one to trust it
+#define BOOT_RECORD_TOLERANCE POSITION(5)
+// how long the actuator has to be still before its position is saved
+#define BOOT_RECORD_SETTLE_TIME 500 // ms
+
+#define BOOT_RECORD_VERSION 2
+// every write goes to the next slot, divides 256 so the sequence wraps
+// with the slots
+#define BOOT_RECORD_SLOTS 16
+
+typedef struct {
+  /* one more than the slot before, the newest slot is where that breaks */
+  unsigned char sequence;
+  /* set while the actuator is at rest, cleared as soon as it moves */
+  char clean_shutdown;
+  int position;
+} boot_record_t;
+
+typedef struct {
+  char version;
+  boot_record_t slots[BOOT_RECORD_SLOTS];
+} boot_record_eeprom_t;
+
+char boot_record_init(int);
+void boot_record_update(char, int);
+
+#endif
@@ -0,0 +1,90 @@
+/***************************************************
+  Cup Filter                          <cup_filter.c>
+
+  Filters the cup detect sonar one ping at a time.
+  A ping with no echo reads 0 cm, which would look
+  like a cup right under the sensor, so a NO_ECHO
+  ping is never added as it is. After
+  CUP_FILTER_NO_ECHO_LIMIT of them in a row the
+  filter adds one CUP_FILTER_FAR_DISTANCE reading
+  instead, so a sensor that hears nothing reads as
+  nothing in range.
+
+  The distance is the median of the last 5 good
+  pings, so one stray echo can not start a blend or
+  stop a clean. Whether a cup is in place has some
+  hysteresis so it does not flicker at the edge.
+***************************************************/
+#include "cup_filter.h"
+
+/* START FUNCTION DESCRIPTION *********************
+  cup_filter_init                     <cup_filter.c>
+
+  SYNTAX: void cup_filter_init( cup_filter_t* );
+
+  DESCRIPTION:
+  Starts the filter with nothing in range and no cup.
+
+  PARAMETER1: The filter to reset
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void cup_filter_init(cup_filter_t* filter) {
+  memset(filter, 0, sizeof(cup_filter_t));
+  filter->distance = CUP_FILTER_FAR_DISTANCE;
+  filter->cup_present = 0;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  cup_filter_add                      <cup_filter.c>
+
+  SYNTAX: void cup_filter_add( cup_filter_t*, int reading );
+
+  DESCRIPTION:
+  Adds one ping and updates the distance and the
+  cup present state.
+
+  PARAMETER1: The filter
+  PARAMETER2: The ping in cm, NO_ECHO if none came back
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void cup_filter_add(cup_filter_t* filter, int reading) {
+  int sorted[CUP_FILTER_SIZE];
+  int value;
+  unsigned char i, j;
+
+  if (reading == 0) {
+    if (++filter->no_echo_count < CUP_FILTER_NO_ECHO_LIMIT) {
+      return;
+    }
+    filter->no_echo_count = 0;
+    reading = CUP_FILTER_FAR_DISTANCE;
+  } else {
+    filter->no_echo_count = 0;
+  }
+
+  filter->readings[filter->index] = reading;
+  if (++filter->index >= CUP_FILTER_SIZE) {
+    filter->index = 0;
+  }
+  if (filter->count < CUP_FILTER_SIZE) {
+    filter->count++;
+  }
+
+  // insertion sort, the buffer is tiny
+  for (i = 0; i < filter->count; i++) {
+    value = filter->readings[i];
+    for (j = i; j > 0 && sorted[j - 1] > value; j--) {
+      sorted[j] = sorted[j - 1];
+    }
+    sorted[j] = value;
+  }
+  filter->distance = sorted[filter->count / 2];
+
+  if (filter->distance < CUP_PRESENT_DISTANCE) {
+    filter->cup_present = 1;
+  } else if (filter->distance > CUP_ABSENT_DISTANCE) {
+    filter->cup_present = 0;
+  }
+}
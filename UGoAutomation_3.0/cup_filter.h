@@ -0,0 +1,28 @@
+#ifndef CUP_FILTER_H
+#define CUP_FILTER_H
+
+#include "global.h"
+
+#define CUP_FILTER_SIZE 5
+// a cup is in place once the distance drops below CUP_PRESENT_DISTANCE and
+// gone once it rises above CUP_ABSENT_DISTANCE
+#define CUP_PRESENT_DISTANCE 15 // cm
+#define CUP_ABSENT_DISTANCE 18 // cm
+// this many NO_ECHO pings in a row count as nothing in range
+#define CUP_FILTER_NO_ECHO_LIMIT 10
+#define CUP_FILTER_FAR_DISTANCE 200 // cm
+
+typedef struct {
+  int readings[CUP_FILTER_SIZE];
+  unsigned char index;
+  unsigned char count;
+  unsigned char no_echo_count;
+  /* median of the last readings, cm */
+  int distance;
+  char cup_present;
+} cup_filter_t;
+
+void cup_filter_init(cup_filter_t*);
+void cup_filter_add(cup_filter_t*, int);
+
+#endif
@@ -21,6 +21,21 @@ extern "C" {
 
 #define NUMBER_OF_MACHINES 1
 
+// main loop task periods (us)
+#define TASK_PERIOD_POSITION 1000 // 1 kHz
+#define TASK_PERIOD_COMMS 2000
+#define TASK_PERIOD_INPUTS 5000 // 200 Hz, a press is seen after 4 stable samples
+#define TASK_PERIOD_SONAR 50000 // 20 Hz
+#define TASK_PERIOD_MOTION 2000 // 500 Hz
+#define TASK_PERIOD_HEARTBEAT 1000000 // 1 Hz
+#define TASK_PERIOD_MEMORY 1000000
+
+// low power idle periods, the keypad and USB keep their full rate so
+// they can wake the station straight away
+#define TASK_PERIOD_POSITION_LOW 100000
+#define TASK_PERIOD_SONAR_LOW 500000
+#define TASK_PERIOD_MOTION_LOW 50000
+
 #define FIRMWARE_VERSION_MAJOR 0
 #define FIRMWARE_VERSION_MINOR 0
 #define FIRMWARE_REVISION      1
@@ -30,6 +45,8 @@ extern "C" {
 #define MACHINE_STATE_CLEANING 2
 #define MACHINE_STATE_INITIALIZING 3
 #define MACHINE_STATE_STEPPING 4
+#define MACHINE_STATE_CALIBRATING 5
+#define MACHINE_STATE_COUNT 6
 
 #define MACHINE_CYCLE_TYPE_AUTO 0
 #define MACHINE_CYCLE_TYPE_STEP 1
@@ -37,17 +54,26 @@ extern "C" {
 #define ON HIGH
 #define OFF LOW
 
+// EEPROM layout
+#define EEPROM_SPEED_MODEL_ADDRESS 0
+#define EEPROM_BOOT_RECORD_ADDRESS 32
+
+
+// positions are 12 bit, see position_adc.c. The calibration
+// measurements and recipe offsets are in the old 10 bit counts
+#define POSITION_SCALE 4
+#define POSITION(counts) ((counts) * POSITION_SCALE)
 
 //Distance Calibration Measurments
 
 // 12" Actuator
 #ifdef TWELVE_INCH_ACTUATOR
-  #define TOP_POSITION 145
-  #define TOP_OF_CUP 210//310
-  #define TOP_OF_SMOOTHIE 250//340 
-  #define BOTTOM_OF_CUP 340//405
-  #define BOTTOM_OF_CLEANING 405
-  #define CLEANING_LEVEL 358 
+  #define TOP_POSITION POSITION(145)
+  #define TOP_OF_CUP POSITION(210)//310
+  #define TOP_OF_SMOOTHIE POSITION(250)//340 
+  #define BOTTOM_OF_CUP POSITION(340)//405
+  #define BOTTOM_OF_CLEANING POSITION(405)
+  #define CLEANING_LEVEL POSITION(358) 
 #else
 //6" Actuator
   //#define TOP_POSITION 330
@@ -58,12 +84,12 @@ extern "C" {
   //#define CLEANING_LEVEL 400
   
 //4" Actuator  
-  #define TOP_POSITION 360 //320
-  #define TOP_OF_CUP 450 // 380
-  #define TOP_OF_SMOOTHIE 455 // 410
-  #define BOTTOM_OF_CUP 595//585
-  #define BOTTOM_OF_CLEANING 660 
-  #define CLEANING_LEVEL 573
+  #define TOP_POSITION POSITION(360) //320
+  #define TOP_OF_CUP POSITION(450) // 380
+  #define TOP_OF_SMOOTHIE POSITION(455) // 410
+  #define BOTTOM_OF_CUP POSITION(595)//585
+  #define BOTTOM_OF_CLEANING POSITION(660) 
+  #define CLEANING_LEVEL POSITION(573)
 #endif // actuator length
 
 #endif
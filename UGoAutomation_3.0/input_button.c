@@ -1,26 +1,90 @@
+/***************************************************
+  Input Button                      <input_button.c>
 
+  Debounces the whole keypad at once. Each PINx
+  register the keypad is wired to is read once per
+  pass, so all buttons on a port are sampled in the
+  same instant, and every button takes its bit of
+  one mask from that read. 2 bit vertical counters
+  (one bit of each counter per button) then count
+  how many samples in a row each button has differed
+  from its debounced state. After DEBOUNCE_SAMPLES
+  the bit flips, so a press is acted on as soon as
+  it is stable instead of after a fixed delay.
+
+  current_state is only written when a button
+  changes, so a state set over USB is kept until
+  the button itself is pressed or released.
+***************************************************/
 #include "input_button.h"
 
 void input_button_init(input_button_t* input_button, char address) {
   input_button->address = address;
   input_button->current_state = 0;
-  input_button->last_state = 0;
-  input_button->last_debounce_time = millis();
+  // pin 0 is the serial port, used as "not connected"
+  if (address == 0 || digitalPinToPort(address) == NOT_A_PIN) {
+    input_button->input_register = 0;
+    input_button->bit_mask = 0;
+    return;
+  }
+  input_button->input_register = portInputRegister(digitalPinToPort(address));
+  input_button->bit_mask = digitalPinToBitMask(address);
   pinMode(input_button->address, INPUT_PULLUP);
 }
 
-void input_button_read(input_button_t* input) {
-  int reading = digitalRead(input->address);
+/* START FUNCTION DESCRIPTION *********************
+  input_button_read_all            <input_button.c>
 
-  if (reading != input->last_state) {
-    input->last_debounce_time = millis();
-  }
+  SYNTAX: void input_button_read_all( input_button_t* buttons, char count, input_debounce_t* debounce );
+
+  DESCRIPTION:
+  Samples every button and runs one debounce step
+  for all of them together. Call at a fixed rate.
+
+  PARAMETER1: The buttons, in bit order
+  PARAMETER2: How many buttons, at most INPUT_BUTTON_MAX
+  PARAMETER3: The debounce state for these buttons
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void input_button_read_all(input_button_t* buttons, char count, input_debounce_t* debounce) {
+  volatile uint8_t* ports[INPUT_BUTTON_MAX];
+  uint8_t pins[INPUT_BUTTON_MAX];
+  char port_count = 0;
+  unsigned int sample = 0;
+  unsigned int delta, toggle;
+  char i, p;
 
-  if ((millis() - input->last_debounce_time) > DEBOUNCING_TIME) {
-    if (reading != input->current_state) {
-      input->current_state = reading;
+  for (i = 0; i < count; i++) {
+    if (!buttons[(int)i].bit_mask) {
+      continue;
+    }
+    // the keypad is on a few ports, each one is read the first time a
+    // button on it comes up
+    for (p = 0; p < port_count && ports[(int)p] != buttons[(int)i].input_register; p++);
+    if (p == port_count) {
+      ports[(int)p] = buttons[(int)i].input_register;
+      pins[(int)p] = *ports[(int)p];
+      port_count++;
+    }
+    if (pins[(int)p] & buttons[(int)i].bit_mask) {
+      sample |= 1 << i;
     }
   }
 
-  input->last_state = reading;
+  // count up while a bit differs from its debounced state, reset when not
+  delta = sample ^ debounce->state;
+  debounce->count1 = (debounce->count1 ^ debounce->count0) & delta;
+  debounce->count0 = ~debounce->count0 & delta;
+  toggle = delta & ~(debounce->count0 | debounce->count1);
+  debounce->state ^= toggle;
+
+  if (!toggle) {
+    return;
+  }
+  for (i = 0; i < count; i++) {
+    if (toggle & (1 << i)) {
+      buttons[(int)i].current_state = (debounce->state >> i) & 1;
+    }
+  }
 }
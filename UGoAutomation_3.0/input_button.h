@@ -3,16 +3,26 @@
 
 #include "global.h"
 
-#define DEBOUNCING_TIME 150
+// samples in a row a button has to read the same before it changes,
+// fixed by the 2 bit vertical counters
+#define DEBOUNCE_SAMPLES 4
+#define INPUT_BUTTON_MAX 16
 
 typedef struct {
   char address;
   char current_state;
-  char last_state;
-  long last_debounce_time;
+  volatile uint8_t* input_register;
+  uint8_t bit_mask;
 } input_button_t;
 
+// debounce state of up to INPUT_BUTTON_MAX buttons, one bit each
+typedef struct {
+  unsigned int state;
+  unsigned int count0;
+  unsigned int count1;
+} input_debounce_t;
+
 void input_button_init( input_button_t*, char );
-void input_button_read( input_button_t* );
+void input_button_read_all( input_button_t*, char, input_debounce_t* );
 
 #endif
@@ -7,17 +7,133 @@
   Usage example:
   LOG_PRINT(LOGGER_INFO, "Received data from USB, byte count: %d", byte_count);
 
+  Logs are recorded in binary, the site, the time
+  and the raw arguments, and sent in batches from
+  the comms task. tools/log_sites.py extracts the
+  format strings from the source and
+  tools/log_decode.py turns the records back into
+  text on the host.
+
+  A site that repeats itself is folded: the same
+  arguments again within LOG_REPEAT_INTERVAL, or
+  anything within the site's own interval, are
+  counted instead of recorded, and the count goes
+  out as a LOG_REPEATED record when the site logs
+  again or goes quiet.
+
   Current supported formatting charaters are %s
-  for string and %d for numbers
+  for string, %d/%u/%x/%c for numbers and %ld/%lu/%lx
+  for longs
 
   SM033116
 ***************************************************/
+#define LOG_FILE_ID 4
 #include "logger.h"
 #include "usb_comm.h"
+#include "profile.h"
+#include <string.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+// length, level, file, line and time
+#define LOG_RECORD_HEADER 9
+#define LOG_RECORD_MAX 64
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
 
 // log level
 char log_level;
 
+// written by log_print, read by logger_flush
+static unsigned char log_ring[LOG_RING_SIZE];
+static volatile unsigned char log_ring_head;
+static volatile unsigned char log_ring_tail;
+static unsigned int log_dropped;
+
+// the sites that logged last, for folding repeats
+typedef struct {
+  const log_site_t* site;
+  unsigned long last;
+  unsigned int held;
+  /* CRC16 of the arguments of the last record */
+  unsigned int hash;
+} log_history_t;
+
+static log_history_t log_history[LOG_HISTORY_SIZE];
+
+// a record goes in whole or not at all
+static void log_ring_put(unsigned char* record, unsigned char length) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (((log_ring_tail - log_ring_head - 1) & LOG_RING_MASK) < length) {
+      log_dropped++;
+    } else {
+      while (length--) {
+        log_ring[log_ring_head] = *record++;
+        log_ring_head = (log_ring_head + 1) & LOG_RING_MASK;
+      }
+    }
+  }
+}
+
+// records how many times a site was held back, as a record of the site
+// with LOG_REPEATED in the level and the count as its argument
+static void log_history_report(log_history_t* entry, unsigned long time) {
+  log_site_t site;
+  unsigned char record[LOG_RECORD_HEADER + 2];
+
+  if (!entry->site || !entry->held) {
+    return;
+  }
+  memcpy_P(&site, entry->site, sizeof(site));
+  record[0] = sizeof(record);
+  record[1] = site.level | LOG_REPEATED;
+  record[2] = site.file;
+  memcpy(&record[3], &site.line, 2);
+  memcpy(&record[5], &time, 4);
+  memcpy(&record[LOG_RECORD_HEADER], &entry->held, 2);
+  log_ring_put(record, sizeof(record));
+  entry->held = 0;
+}
+
+// 1 when the record should be kept, 0 when it is a repeat or too soon
+// after the last one of the site and is only counted
+static char log_history_pass(const log_site_t* site_P, const log_site_t* site,
+  const unsigned char* args, unsigned char length, unsigned long time) {
+  log_history_t* entry = log_history;
+  log_history_t* oldest = log_history;
+  unsigned int hash = CRC_INIT;
+  unsigned char i;
+
+  for (i = 0; i < length; i++) {
+    hash = _crc_ccitt_update(hash, args[i]);
+  }
+
+  for (i = 0; i < LOG_HISTORY_SIZE; i++, entry++) {
+    if (entry->site == site_P) {
+      if (time - entry->last < site->interval ||
+          (hash == entry->hash && time - entry->last < LOG_REPEAT_INTERVAL)) {
+        if (entry->held != 0xFFFF) {
+          entry->held++;
+        }
+        return 0;
+      }
+      log_history_report(entry, time);
+      entry->last = time;
+      entry->hash = hash;
+      return 1;
+    }
+    // an empty entry first, then the one that logged longest ago
+    if (oldest->site && (!entry->site || time - entry->last > time - oldest->last)) {
+      oldest = entry;
+    }
+  }
+
+  log_history_report(oldest, time);
+  oldest->site = site_P;
+  oldest->last = time;
+  oldest->hash = hash;
+  return 1;
+}
+
 /* START FUNCTION DESCRIPTION *********************
   logger_init                              <logger.c>
 
@@ -32,6 +148,10 @@ char log_level;
   END DESCRIPTION ***********************************/
 void logger_init()
 {
+  log_ring_head = 0;
+  log_ring_tail = 0;
+  log_dropped = 0;
+  memset(log_history, 0, sizeof(log_history));
   log_level = 0;
   //LOGGER_ASSERT | LOGGER_ERROR | LOGGER_VERBOSE;// | LOGGER_DEBUG;
 }
@@ -39,92 +159,171 @@ void logger_init()
 /* START FUNCTION DESCRIPTION *********************
   log_print                                <logger.c>
 
-  SYNTAX: void log_print( char* filename, int line, enum LOGGER_LEVEL level, char *fmt,... );
+  SYNTAX: void log_print( const log_site_t* site_P, ... );
 
   DESCRIPTION:
-  Stores items that meet thel log_level into the log history and send the item
-  to the USBUART
+  Records a log into the ring for logger_flush to
+  send. LOG_PRINT has already checked the level
+  against log_level, call it through that. Nothing is
+  formatted here, the record is the site, the time
+  and the arguments as the format says they are:
+  2 bytes for %d/%u/%x/%c, 4 for %ld/%lu/%lx and up
+  to LOG_STRING_MAX characters and a 0 for %s. A
+  record that does not fit is dropped and counted.
+  Repeats of a site are counted rather than
+  recorded, see log_history_pass.
 
-  PARAMETER1: The file that called the function
-  PARAMETER2: The line number the call originated from
-  PARAMETER3: The type of log
-  PARAMETER4: Formatted string
-  PARAMETER5: VA list of items to format
+  PARAMETER1: The call site in flash, from LOG_PRINT
+  PARAMETER2: VA list of items to format
 
   RETURN VALUE:  null
 
   SM033116
   END DESCRIPTION ***********************************/
-void log_print(char* filename, int line, enum LOGGER_LEVEL level, char *fmt, ...)
+void log_print(const log_site_t* site_P, ...)
 {
-  // only log elements that are in the include list
-  if (log_level & level)
-  {
-    va_list list;
-    char *p;
-    char *r;
-    int e;
-    int i = 0;
-    char log_builder[200];
-
-    memset(log_builder, 0, 200);
+  unsigned long start = micros();
+  log_site_t site;
+  va_list list;
+  const char* p;
+  char c;
+  char* r;
+  unsigned char record[LOG_RECORD_MAX];
+  unsigned char i = LOG_RECORD_HEADER;
+  unsigned long time = millis();
+  unsigned int value;
+  unsigned long long_value;
+  unsigned char n;
 
-    // print out where we came from
-    i = sprintf((char*)&log_builder[0], " [%s][line: %d] ", filename, line);
+  memcpy_P(&site, site_P, sizeof(site));
 
-    // print out severity, maybe change this to string in future
-    log_builder[i++] = level;
+  // start parsing the arguments
+  va_start( list, site_P );
 
-    // start parsing the log message
-    va_start( list, fmt );
+  // stop with room left for at least the 0 of a string
+  for ( p = site.format ; i < LOG_RECORD_MAX - 1 && (c = pgm_read_byte(p)) ; ++p )
+  {
+    if ( c != '%' )
+    {
+      continue;
+    }
+    c = pgm_read_byte(++p);
+    if ( c == 'l' )
+    {
+      ++p;
+      long_value = va_arg( list, unsigned long );
+      if (i + 4 > LOG_RECORD_MAX) break;
+      memcpy(&record[i], &long_value, 4);
+      i += 4;
+      continue;
+    }
 
-    for ( p = fmt ; *p ; ++p )
+    switch ( c )
     {
-      if ( *p != '%' )//If simple string
-      {
-        log_builder[i++] = *p;
-      }
-      else
-      {
-        switch ( *++p )
-        {
-          /* string */
-          case 's':
-            {
-              r = va_arg( list, char * );
-              i += sprintf((char*)&log_builder[i], "%s", r);
-              continue;
-            }
-
-          /* integer */
-          case 'd':
-            {
-              e = va_arg( list, int );
-
-              i += sprintf((char*)&log_builder[i], "%d", e);
-              continue;
-            }
-
-          default:
-            log_builder[i++] = *p;
+      /* string */
+      case 's':
+        r = va_arg( list, char * );
+        for (n = 0; n < LOG_STRING_MAX && r[n] && i < LOG_RECORD_MAX - 1; n++) {
+          record[i++] = r[n];
         }
-      }
+        record[i++] = 0;
+        break;
+
+      /* integer */
+      case 'd':
+      case 'u':
+      case 'x':
+      case 'c':
+        value = va_arg( list, int );
+        if (i + 2 > LOG_RECORD_MAX) break;
+        memcpy(&record[i], &value, 2);
+        i += 2;
+        break;
+
+      case 0:
+        p--;
+        break;
+    }
+  }
+  
+  va_end( list );
+
+  record[0] = i;
+  record[1] = site.level;
+  record[2] = site.file;
+  memcpy(&record[3], &site.line, 2);
+  memcpy(&record[5], &time, 4);
+  // an assert always goes out
+  if (site.level == LOGGER_ASSERT ||
+      log_history_pass(site_P, &site, &record[LOG_RECORD_HEADER], i - LOG_RECORD_HEADER, time)) {
+    log_ring_put(record, i);
+  }
+
+  // if an assert fails, send what is logged and stay in infinite loop
+  if (site.level == LOGGER_ASSERT) {
+    while (log_ring_head != log_ring_tail) {
+      logger_flush();
     }
-    
-    va_end( list );
-    
+    while (1) {}
+  }
+  profile_end(PROFILE_LOG, start);
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  logger_flush                             <logger.c>
+
+  SYNTAX: void logger_flush( void );
+
+  DESCRIPTION:
+  Sends the records waiting in the ring to the HMI,
+  as many whole records as fit in a MSG_LOG_BINARY.
+  The message starts with the number of records
+  dropped since the last one. The count of a site
+  that went quiet after being folded is recorded
+  here once LOG_REPEAT_INTERVAL has passed. Called
+  from the comms task.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void logger_flush()
+{
 #ifdef USB_COMMUNICATION
-    hmi_message_t msg;
-    msg.message_id = MSG_LOG;
-    msg.log_message.level = level;
-    memset(&msg.log_message.message, 0, sizeof(msg.log_message.message));
-    memcpy(&msg.log_message.message, &log_builder, i);
-    c_send_message(msg, i + 1);
-#endif
+  hmi_message_t msg;
+  unsigned int size = 2;
+  unsigned char length;
+  unsigned long time = millis();
+  unsigned char i;
+
+  for (i = 0; i < LOG_HISTORY_SIZE; i++) {
+    if (log_history[i].held && time - log_history[i].last >= LOG_REPEAT_INTERVAL) {
+      log_history_report(&log_history[i], time);
+    }
+  }
+
+  if (log_ring_head == log_ring_tail && !log_dropped) {
+    return;
+  }
+
+  msg.message_id = MSG_LOG_BINARY;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    memcpy(msg.payload, &log_dropped, 2);
+    log_dropped = 0;
+  }
 
-    // if an assert fails, keep in infinite loop
-    while (level == LOGGER_ASSERT) {}
+  while (log_ring_head != log_ring_tail) {
+    length = log_ring[log_ring_tail];
+    if (size + length > MAX_HMI_PAYLOAD_SIZE) {
+      break;
+    }
+    while (length--) {
+      msg.payload[size++] = log_ring[log_ring_tail];
+      log_ring_tail = (log_ring_tail + 1) & LOG_RING_MASK;
+    }
   }
+  c_send_message(msg, size);
+#else
+  log_ring_tail = log_ring_head;
+#endif
 }
 
 /* START FUNCTION DESCRIPTION *********************
@@ -2,11 +2,59 @@
 #define __LOGGER_H
     
     #include "global.h"
+    #include <avr/pgmspace.h>
     
-    #define MAX_LOG_SIZE 100
-    
-    // Macro definition for printing information to the logs
-    #define LOG_PRINT(level, ...) log_print(__FILE__, __LINE__, level, __VA_ARGS__ )
+    // records waiting to go to the HMI, power of 2 up to 256
+    #define LOG_RING_SIZE 256
+    // longest %s argument kept in a record
+    #define LOG_STRING_MAX 16
+
+    // sites remembered for rate limiting and folding repeats
+    #define LOG_HISTORY_SIZE 8
+    // a site logging the same arguments again within this is counted
+    // rather than recorded, ms
+    #define LOG_REPEAT_INTERVAL 1000
+    // least time between two records of a site, ms, 0 is no limit,
+    // LOG_PRINT_INTERVAL sets it for one site
+    #define LOG_SITE_INTERVAL 0
+    // set in the level of the record that reports how many were held back
+    #define LOG_REPEATED 0x80
+
+    // every file that logs defines its own id before including anything,
+    // tools/log_sites.py reads them to tell the host which file a record
+    // came from
+    #ifndef LOG_FILE_ID
+    #define LOG_FILE_ID 0
+    #endif
+
+    // levels built into the firmware, a LOG_PRINT of any other level
+    // compiles to nothing. The levels are a mask, not an order, so this
+    // lists every level kept rather than a minimum. Debug is left out of
+    // the default build, define LOG_COMPILED_LEVELS to LOGGER_ALL to get
+    // it back.
+    #define LOGGER_ALL 0x3F
+    #ifndef LOG_COMPILED_LEVELS
+    #define LOG_COMPILED_LEVELS (LOGGER_ALL & ~LOGGER_DEBUG)
+    #endif
+
+    // Macro definition for printing information to the logs. Only the
+    // site and the raw arguments are recorded, the text is put together
+    // on the host, see tools/log_decode.py. The level is checked before
+    // the arguments are evaluated, against LOG_COMPILED_LEVELS when
+    // compiling and log_level when running. The site and its format are
+    // kept in flash.
+    #define LOG_PRINT(level, fmt, ...) \
+      LOG_PRINT_INTERVAL(level, LOG_SITE_INTERVAL, fmt, ##__VA_ARGS__)
+
+    // LOG_PRINT for a site that would log on every pass, it records at
+    // most once every interval ms and counts the rest
+    #define LOG_PRINT_INTERVAL(level, interval, fmt, ...) do { \
+        if (((level) & LOG_COMPILED_LEVELS) && ((level) & log_level)) { \
+          static const char log_format[] PROGMEM = fmt; \
+          static const log_site_t log_site PROGMEM = { LOG_FILE_ID, (level), __LINE__, (interval), log_format }; \
+          log_print(&log_site, ##__VA_ARGS__); \
+        } \
+      } while (0)
     
     enum LOGGER_LEVEL {
         // use to log a terrible occurence.
@@ -32,8 +80,21 @@
         LOGGER_WARNING = 32 
     };
     
+    // one for every LOG_PRINT, in flash, format points to flash as well
+    typedef struct {
+      unsigned char file;
+      unsigned char level;
+      unsigned int line;
+      unsigned int interval;
+      const char* format;
+    } log_site_t;
+
+    // levels sent at run time, see set_log_level
+    extern char log_level;
+
     void logger_init();
-    void log_print(char* filename, int line, enum LOGGER_LEVEL level, char *fmt,...);    
+    void log_print(const log_site_t* site_P, ...);
+    void logger_flush();
     void set_log_level(char level);
     
 #endif
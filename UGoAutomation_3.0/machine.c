@@ -33,6 +33,7 @@
 
   SM070716
 ***************************************************/
+#define LOG_FILE_ID 5
 #include "machine.h"
 #include "actions.h"
 
@@ -40,19 +41,28 @@
 char step_request;
 int jam_counter = 0;//add
 
+static void machine_idle_enter(machine_t*);
+
 
 void machine_init(machine_t* machine_ptr) {
-  pinMode(13, OUTPUT);
   machine_ptr->is_initialized = 0;
+  machine_ptr->ready_reported = 0;
   machine_ptr->keypad_enabled = 1;
   machine_ptr->current_state = MACHINE_STATE_IDLE;
-  machine_ptr->last_cup_read_time = millis();
+  machine_ptr->step_timer.state = SOFT_TIMER_IDLE;
+  machine_ptr->step_timer.next = NULL;
 
   // MAGIC NUMBERS FOR NOW, DEFINE AFTER......
   machine_ptr->cup_detect_sensor = new_ping_c_wrapper_init(12,11);
+  cup_filter_init(&machine_ptr->cup_filter);
+  machine_ptr->cup_detect_reading = machine_ptr->cup_filter.distance;
   
   // initialize the blender
   blender_init(&machine_ptr->blender);
+  speed_model_init();
+
+  // no need to home if it was left at rest where it is now
+  machine_ptr->is_initialized = boot_record_init(machine_ptr->blender.position);
 
   input_button_init(&machine_ptr->buttons[BLEND_BUTTON], 41);
   input_button_init(&machine_ptr->buttons[CLEAN_BUTTON], 39);
@@ -65,55 +75,60 @@ void machine_init(machine_t* machine_ptr) {
   
   input_button_init(&machine_ptr->buttons[REBLEND_BUTTON], 33);
   input_button_init(&machine_ptr->buttons[JOG_PUMP_BUTTON], 31);
+  memset(&machine_ptr->debounce, 0, sizeof(machine_ptr->debounce));
   step_request = 0;
+
+  machine_idle_enter(machine_ptr);
 }
 
-void machine_process(machine_t* machine_ptr) {
-  int i;
+// position task, takes the newest reading from the position ADC
+void machine_update_position(machine_t* machine_ptr) {
   update_current_position(&machine_ptr->blender);
+}
 
-  if ((machine_ptr->last_cup_read_time + 500) < millis()) {
-    machine_ptr->cup_detect_reading = new_ping_c_wrapper_sonar_ping(machine_ptr->cup_detect_sensor);    
+// sonar task, picks up the last ping and sends the next one. The echo is
+// timed in the background so this never waits on it
+void machine_read_sonar(machine_t* machine_ptr) {
+  int reading;
+
+  if (new_ping_c_wrapper_sonar_poll(machine_ptr->cup_detect_sensor, &reading)) {
+    cup_filter_add(&machine_ptr->cup_filter, reading);
+    machine_ptr->cup_detect_reading = machine_ptr->cup_filter.distance;
     //LOG_PRINT(LOGGER_VERBOSE, "Reading: %d address:%d", machine_ptr->cup_detect_reading, &machine_ptr->cup_detect_reading);
-    machine_ptr->last_cup_read_time = millis();
   }
+  new_ping_c_wrapper_sonar_start(machine_ptr->cup_detect_sensor);
+}
 
+// button task, reads the keypad and starts or stops cycles
+void machine_read_inputs(machine_t* machine_ptr) {
   // ---------- BEGING INPUT BUTTON SECTION ----------
   if (machine_ptr->keypad_enabled) {
-    for (i = 0; i < BUTTON_COUNT; i++) {
-      input_button_read(&machine_ptr->buttons[i]);
-    }
+    input_button_read_all(machine_ptr->buttons, BUTTON_COUNT, &machine_ptr->debounce);
   }
 
   if (machine_ptr->current_state == MACHINE_STATE_IDLE) {
     if (machine_ptr->buttons[BLEND_BUTTON].current_state) {
       LOG_PRINT(LOGGER_VERBOSE, "Blender button pushed, starting blending, total actions: %d", blend_sequence.total_actions );
-      machine_ptr->current_state = MACHINE_STATE_BLENDING;
+      machine_change_state(machine_ptr, MACHINE_STATE_BLENDING);
     } else if (machine_ptr->buttons[CLEAN_BUTTON].current_state) {
       LOG_PRINT(LOGGER_VERBOSE, "Cleaning button pushed, starting cleaning");
-      machine_ptr->current_state = MACHINE_STATE_CLEANING;
+      machine_change_state(machine_ptr, MACHINE_STATE_CLEANING);
     } else if (machine_ptr->buttons[REBLEND_BUTTON].current_state) {
       LOG_PRINT(LOGGER_VERBOSE, "Reblender button pushed, starting reblending, total actions: %d", blend_sequence.total_actions );
       blend_sequence.actions_ptr[5].activate.state = OFF;
       blend_sequence.actions_ptr[64].activate.state = OFF;
-      machine_ptr->current_state = MACHINE_STATE_BLENDING;
+      machine_change_state(machine_ptr, MACHINE_STATE_BLENDING);
     }
   }
   
   if (machine_ptr->buttons[INITIALIZE].current_state) {
     LOG_PRINT(LOGGER_VERBOSE, "Initializing");
-    blend_actions_init(1);
-    machine_ptr->current_state = MACHINE_STATE_INITIALIZING;
-    //add: solve the initialization that blade and actuator stop asynchronous
-    //machine_stop(machine_ptr);
+    machine_change_state(machine_ptr, MACHINE_STATE_INITIALIZING);
   }
   
   if (machine_ptr->buttons[STOP_BUTTON].current_state && machine_ptr->current_state != MACHINE_STATE_IDLE) {
     LOG_PRINT(LOGGER_VERBOSE, "Stop button pushed, stopping machine");
-    machine_stop(machine_ptr);
-    blend_actions_init(1);
-    machine_ptr->current_state = MACHINE_STATE_IDLE;
-    
+    machine_change_state(machine_ptr, MACHINE_STATE_IDLE);
   }
 
 //  if (machine_ptr->buttons[STEP_BUTTON].current_state) {
@@ -135,136 +150,291 @@ void machine_process(machine_t* machine_ptr) {
     machine_ptr->cup_detect_reading);
 
   // ---------- END INPUT BUTTON SECTION ----------
+}
 
-  // change to mediator rather than switch
-  switch (machine_ptr->current_state) {
-    case MACHINE_STATE_IDLE:    
-      if (machine_ptr->buttons[MOVE_UP].current_state) {
-        LOG_PRINT(LOGGER_VERBOSE, "MOVING UP, current position:%d, speed:%d", machine_ptr->blender.position, MOTOR_SPEED_HALF);
-        blender_move(&machine_ptr->blender, BLENDER_MOVEMENT_UP, MOTOR_SPEED_HALF);
-      } else if (machine_ptr->buttons[MOVE_DOWN].current_state) {
-        LOG_PRINT(LOGGER_VERBOSE, "MOVING DOWN, current position:%d, speed:%d", machine_ptr->blender.position, MOTOR_SPEED_HALF);
-        blender_move(&machine_ptr->blender, BLENDER_MOVEMENT_DOWN, MOTOR_SPEED_HALF);
-      } else {
-        //LOG_PRINT(LOGGER_VERBOSE, "IDLE");
-        machine_stop(machine_ptr);
-        blender_move(&machine_ptr->blender, BLENDER_MOVEMENT_IDLE, 0);
-      }
-      //jog pump top
-      if (machine_ptr->buttons[JOG_PUMP_BUTTON].current_state) {
-        //LOG_PRINT(LOGGER_VERBOSE, "MOVING DOWN, current position:%d, speed:%d", machine_ptr->blender.position, MOTOR_SPEED_HALF);
-        digitalWrite(PUMP_ADDRESS, 0);
-        digitalWrite(LIQUID_FILLING_VALVE_ADDRESS, 0);  
-      } else if (!machine_ptr->buttons[JOG_PUMP_BUTTON].current_state) {
-        //LOG_PRINT(LOGGER_VERBOSE, "MOVING DOWN, current position:%d, speed:%d", machine_ptr->blender.position, MOTOR_SPEED_HALF);
-        digitalWrite(PUMP_ADDRESS, 1);
-        digitalWrite(LIQUID_FILLING_VALVE_ADDRESS, 1);
-      }
+// ---------- STATE HANDLERS ----------
+// enter runs once when a state is entered, exit once when it is left and
+// tick on every motion task pass while it is the current state
+
+static void machine_idle_enter(machine_t* machine_ptr) {
+  machine_stop(machine_ptr);
+  blender_move(&machine_ptr->blender, BLENDER_MOVEMENT_IDLE, 0);
+  // temp hack for now, just to keep valves closed
+  outputs_write(OUTPUT_CLEANING_VALVE, HIGH);
+  machine_ptr->current_step = 0;
+  machine_ptr->stall_samples = 0;
+  machine_restart_step(machine_ptr);
+}
 
-      // temp hack for now, just to keep valves closed
-      if (digitalRead(CLEANING_VALVE_ADDRESS) != 1) {
-         digitalWrite(CLEANING_VALVE_ADDRESS, 1);
-      }
-      
-      
-      machine_ptr->current_step = 0;
-      machine_ptr->last_step_time = millis();
-      machine_ptr->last_jam_check_position = millis();
-      break;
-    case MACHINE_STATE_BLENDING:
-      if (machine_execute_action(machine_ptr, &blend_sequence.actions_ptr[machine_ptr->current_step])) {
-        // reset jam issue
-        machine_ptr->last_jam_check_position = machine_ptr->blender.position;
-        machine_ptr->last_jam_check_time = millis();
-
-        // we finished the last action, let's move to the next action.
-        LOG_PRINT(LOGGER_VERBOSE, "Bending step %d completed, percent complete:%d", machine_ptr->current_step, (100*machine_ptr->current_step+1)/blend_sequence.total_actions);
-        if (blend_sequence.actions_ptr[machine_ptr->current_step].type == ACTION_MTP) {
-          LOG_PRINT(LOGGER_VERBOSE, "current position:%d, desired position:%d, direction:%d", machine_ptr->blender.position, blend_sequence.actions_ptr[machine_ptr->current_step].mtp.new_position, blend_sequence.actions_ptr[machine_ptr->current_step].mtp.move_direction);
-        } else if (blend_sequence.actions_ptr[machine_ptr->current_step].type == ACTION_ACTIVATE) {
-          LOG_PRINT(LOGGER_VERBOSE, "toggling output:%d, desired state:%d", blend_sequence.actions_ptr[machine_ptr->current_step].activate.address, blend_sequence.actions_ptr[machine_ptr->current_step].activate.state);
-        }
-        machine_ptr->current_step++;
-        machine_ptr->last_step_time = millis();
-
-        if (machine_ptr->current_step == blend_sequence.total_actions) {
-          LOG_PRINT(LOGGER_VERBOSE, "Blending complete, cleaning machine");
-          machine_ptr->current_step = 0;
-          machine_ptr->current_state = MACHINE_STATE_CLEANING;
-         
-          // Jam detection changes the actual action array, reinitialize when done
-          blend_actions_init(1);
-        }
-      } else {
-        // we need to check if we are actually moving properly
-        if (blend_sequence.actions_ptr[machine_ptr->current_step].type == ACTION_MTP) {
-          machine_check_for_jams(machine_ptr);
-        }
-      }
-      break;
-    case MACHINE_STATE_CLEANING:
-      if (machine_execute_action(machine_ptr, &clean_sequence.actions_ptr[machine_ptr->current_step])) {
-        LOG_PRINT(LOGGER_VERBOSE, "Cleaning step %d completed, percent complete:%d", machine_ptr->current_step, (100*machine_ptr->current_step+1)/clean_sequence.total_actions);
-        if (clean_sequence.actions_ptr[machine_ptr->current_step].type == ACTION_MTP) {
-          LOG_PRINT(LOGGER_VERBOSE, "current position:%d, desired position:%d, direction:%d", machine_ptr->blender.position, clean_sequence.actions_ptr[machine_ptr->current_step].mtp.new_position, clean_sequence.actions_ptr[machine_ptr->current_step].mtp.move_direction);
-        } else if (blend_sequence.actions_ptr[machine_ptr->current_step].type == ACTION_ACTIVATE) {
-          LOG_PRINT(LOGGER_VERBOSE, "toggling output:%d, desired state:%d", blend_sequence.actions_ptr[machine_ptr->current_step].activate.address, blend_sequence.actions_ptr[machine_ptr->current_step].activate.state);
-        }
-        // we finished the last action, let's move to the next action.
-        machine_ptr->current_step++;
-        machine_ptr->last_step_time = millis();
-
-        if (machine_ptr->current_step == clean_sequence.total_actions) {
-          machine_ptr->current_state = MACHINE_STATE_IDLE;
-        }
-      }
-      break;
-    case MACHINE_STATE_STEPPING:
-      if (step_request) {
-        if (machine_execute_action(machine_ptr, &blend_sequence.actions_ptr[machine_ptr->current_step])) {
-          // we finished the last action, let's move to the next action.
-          LOG_PRINT(LOGGER_VERBOSE, "Bending step %d completed, percent complete:%d", machine_ptr->current_step, (100*machine_ptr->current_step)/blend_sequence.total_actions);
-          if (blend_sequence.actions_ptr[machine_ptr->current_step].type == ACTION_MTP) {
-            LOG_PRINT(LOGGER_VERBOSE, "current position:%d, desired position:%d, direction:%d", machine_ptr->blender.position, blend_sequence.actions_ptr[machine_ptr->current_step].mtp.new_position, blend_sequence.actions_ptr[machine_ptr->current_step].mtp.move_direction);
-          }
-          machine_ptr->current_step++;
-          machine_ptr->last_step_time = millis();
-  
-          if (machine_ptr->current_step == blend_sequence.total_actions) {
-            LOG_PRINT(LOGGER_VERBOSE, "Blending complete, stopping machine");
-            machine_ptr->current_state = MACHINE_STATE_IDLE;
-          }
+static void machine_idle_tick(machine_t* machine_ptr) {
+  if (machine_ptr->buttons[MOVE_UP].current_state) {
+    if (machine_ptr->blender.movement != BLENDER_MOVEMENT_UP) {
+      LOG_PRINT(LOGGER_VERBOSE, "MOVING UP, current position:%d, speed:%d", machine_ptr->blender.position, MOTOR_SPEED_HALF);
+      blender_move(&machine_ptr->blender, BLENDER_MOVEMENT_UP, MOTOR_SPEED_HALF);
+    }
+  } else if (machine_ptr->buttons[MOVE_DOWN].current_state) {
+    if (machine_ptr->blender.movement != BLENDER_MOVEMENT_DOWN) {
+      LOG_PRINT(LOGGER_VERBOSE, "MOVING DOWN, current position:%d, speed:%d", machine_ptr->blender.position, MOTOR_SPEED_HALF);
+      blender_move(&machine_ptr->blender, BLENDER_MOVEMENT_DOWN, MOTOR_SPEED_HALF);
+    }
+  } else {
+    // the outputs skip these unless something changed them
+    machine_stop(machine_ptr);
+    if (machine_ptr->blender.movement != BLENDER_MOVEMENT_IDLE) {
+      blender_move(&machine_ptr->blender, BLENDER_MOVEMENT_IDLE, 0);
+    }
+  }
+
+  //jog pump top, the outputs only change on a press or release
+  if (machine_ptr->buttons[JOG_PUMP_BUTTON].current_state) {
+    outputs_write(OUTPUT_PUMP, LOW);
+    outputs_write(OUTPUT_LIQUID_FILLING_VALVE, LOW);
+  } else {
+    outputs_write(OUTPUT_PUMP, HIGH);
+    outputs_write(OUTPUT_LIQUID_FILLING_VALVE, HIGH);
+  }
+  outputs_write(OUTPUT_CLEANING_VALVE, HIGH);
+}
 
-          step_request = 0;
-        }  
+static void machine_sequence_enter(machine_t* machine_ptr) {
+  machine_ptr->current_step = 0;
+  machine_ptr->stall_samples = 0;
+  machine_ptr->blend_block = BLEND_BLOCK_NONE;
+  machine_ptr->recovery_end = 0;
+  machine_restart_step(machine_ptr);
+}
+
+static void machine_blending_tick(machine_t* machine_ptr) {
+  if (machine_execute_action(machine_ptr, &blend_sequence.actions_ptr[machine_ptr->current_step])) {
+    // reset jam issue
+    machine_ptr->stall_samples = 0;
+
+    // we finished the last action, let's move to the next action.
+    LOG_PRINT(LOGGER_VERBOSE, "Bending step %d completed, percent complete:%d", machine_ptr->current_step, (100*machine_ptr->current_step+1)/blend_sequence.total_actions);
+    if (blend_sequence.actions_ptr[machine_ptr->current_step].type == ACTION_MTP) {
+      LOG_PRINT(LOGGER_VERBOSE, "current position:%d, desired position:%d, direction:%d", machine_ptr->blender.position, blend_sequence.actions_ptr[machine_ptr->current_step].mtp.new_position, blend_sequence.actions_ptr[machine_ptr->current_step].mtp.move_direction);
+    } else if (blend_sequence.actions_ptr[machine_ptr->current_step].type == ACTION_ACTIVATE) {
+      LOG_PRINT(LOGGER_VERBOSE, "toggling output:%d, desired state:%d", blend_sequence.actions_ptr[machine_ptr->current_step].activate.address, blend_sequence.actions_ptr[machine_ptr->current_step].activate.state);
+    }
+    machine_ptr->current_step++;
+    machine_restart_step(machine_ptr);
+    machine_adapt_blend(machine_ptr, blend_sequence.actions_ptr[machine_ptr->current_step - 1].type);
+
+    if (machine_ptr->current_step == blend_sequence.total_actions) {
+      LOG_PRINT(LOGGER_VERBOSE, "Blending complete, cleaning machine");
+      machine_change_state(machine_ptr, MACHINE_STATE_CLEANING);
+    }
+  } else {
+    // we need to check if we are actually moving properly
+    if (blend_sequence.actions_ptr[machine_ptr->current_step].type == ACTION_MTP) {
+      machine_check_for_jams(machine_ptr);
+    }
+  }
+}
+
+// Jam detection changes the actual action array, reinitialize when done
+static void machine_blending_exit(machine_t* machine_ptr) {
+  blend_actions_init(1);
+}
+
+static void machine_cleaning_tick(machine_t* machine_ptr) {
+  if (machine_execute_action(machine_ptr, &clean_sequence.actions_ptr[machine_ptr->current_step])) {
+    LOG_PRINT(LOGGER_VERBOSE, "Cleaning step %d completed, percent complete:%d", machine_ptr->current_step, (100*machine_ptr->current_step+1)/clean_sequence.total_actions);
+    if (clean_sequence.actions_ptr[machine_ptr->current_step].type == ACTION_MTP) {
+      LOG_PRINT(LOGGER_VERBOSE, "current position:%d, desired position:%d, direction:%d", machine_ptr->blender.position, clean_sequence.actions_ptr[machine_ptr->current_step].mtp.new_position, clean_sequence.actions_ptr[machine_ptr->current_step].mtp.move_direction);
+    } else if (blend_sequence.actions_ptr[machine_ptr->current_step].type == ACTION_ACTIVATE) {
+      LOG_PRINT(LOGGER_VERBOSE, "toggling output:%d, desired state:%d", blend_sequence.actions_ptr[machine_ptr->current_step].activate.address, blend_sequence.actions_ptr[machine_ptr->current_step].activate.state);
+    }
+    // we finished the last action, let's move to the next action.
+    machine_ptr->current_step++;
+    machine_restart_step(machine_ptr);
+
+    if (machine_ptr->current_step == clean_sequence.total_actions) {
+      machine_change_state(machine_ptr, MACHINE_STATE_IDLE);
+    }
+  }
+}
+
+static void machine_stepping_tick(machine_t* machine_ptr) {
+  if (step_request) {
+    if (machine_execute_action(machine_ptr, &blend_sequence.actions_ptr[machine_ptr->current_step])) {
+      // we finished the last action, let's move to the next action.
+      LOG_PRINT(LOGGER_VERBOSE, "Bending step %d completed, percent complete:%d", machine_ptr->current_step, (100*machine_ptr->current_step)/blend_sequence.total_actions);
+      if (blend_sequence.actions_ptr[machine_ptr->current_step].type == ACTION_MTP) {
+        LOG_PRINT(LOGGER_VERBOSE, "current position:%d, desired position:%d, direction:%d", machine_ptr->blender.position, blend_sequence.actions_ptr[machine_ptr->current_step].mtp.new_position, blend_sequence.actions_ptr[machine_ptr->current_step].mtp.move_direction);
       }
-      break;
-    case MACHINE_STATE_INITIALIZING:
-      //add: solve the initialization that blade and actuator stop asynchronous
-      machine_stop(machine_ptr);
-      //led off
-      digitalWrite(13, LOW);  
-      if (machine_execute_action(machine_ptr, &initializing_action)) {
-        machine_ptr->current_state = MACHINE_STATE_IDLE;
-        machine_ptr->is_initialized = 1;
-        LOG_PRINT(LOGGER_VERBOSE, "Machine Initialized");
+      machine_ptr->current_step++;
+      machine_restart_step(machine_ptr);
+
+      if (machine_ptr->current_step == blend_sequence.total_actions) {
+        LOG_PRINT(LOGGER_VERBOSE, "Blending complete, stopping machine");
+        machine_change_state(machine_ptr, MACHINE_STATE_IDLE);
       }
+
+      step_request = 0;
+    }  
+  }
+}
+
+static void machine_calibrating_enter(machine_t* machine_ptr) {
+  speed_model_calibration_start(&machine_ptr->calibration);
+}
+
+static void machine_calibrating_tick(machine_t* machine_ptr) {
+  if (speed_model_calibrate(&machine_ptr->blender, &machine_ptr->calibration)) {
+    machine_change_state(machine_ptr, MACHINE_STATE_IDLE);
   }
 }
 
+static void machine_initializing_enter(machine_t* machine_ptr) {
+  //add: solve the initialization that blade and actuator stop asynchronous
+  machine_stop(machine_ptr);
+  //led off
+  outputs_write(OUTPUT_STATUS_LED, LOW);
+  machine_restart_step(machine_ptr);
+}
+
+static void machine_initializing_tick(machine_t* machine_ptr) {
+  // already at the top, nothing to move
+  if (machine_ptr->blender.position <= TOP_POSITION + BOOT_RECORD_TOLERANCE || machine_execute_action(machine_ptr, &initializing_action)) {
+    machine_ptr->is_initialized = 1;
+    LOG_PRINT(LOGGER_VERBOSE, "Machine Initialized");
+    machine_change_state(machine_ptr, MACHINE_STATE_IDLE);
+  }
+}
+
+#define STATE_BIT(state) (1 << (state))
+
+// indexed by MACHINE_STATE_, next is the states that may follow. Stopping
+// and homing are always allowed, a cycle only starts from idle and a blend
+// goes on to clean when it ends. Requests from outside the machine go
+// through machine_request_state, which also keeps them from switching
+// one cycle for another
+static const machine_state_t machine_states[MACHINE_STATE_COUNT] = {
+  // MACHINE_STATE_IDLE
+  { machine_idle_enter, machine_idle_tick, NULL,
+    STATE_BIT(MACHINE_STATE_BLENDING) | STATE_BIT(MACHINE_STATE_CLEANING) | STATE_BIT(MACHINE_STATE_INITIALIZING) |
+    STATE_BIT(MACHINE_STATE_STEPPING) | STATE_BIT(MACHINE_STATE_CALIBRATING) },
+  // MACHINE_STATE_BLENDING
+  { machine_sequence_enter, machine_blending_tick, machine_blending_exit,
+    STATE_BIT(MACHINE_STATE_IDLE) | STATE_BIT(MACHINE_STATE_CLEANING) | STATE_BIT(MACHINE_STATE_INITIALIZING) },
+  // MACHINE_STATE_CLEANING
+  { machine_sequence_enter, machine_cleaning_tick, NULL,
+    STATE_BIT(MACHINE_STATE_IDLE) | STATE_BIT(MACHINE_STATE_INITIALIZING) },
+  // MACHINE_STATE_INITIALIZING
+  { machine_initializing_enter, machine_initializing_tick, NULL,
+    STATE_BIT(MACHINE_STATE_IDLE) },
+  // MACHINE_STATE_STEPPING
+  { machine_sequence_enter, machine_stepping_tick, machine_blending_exit,
+    STATE_BIT(MACHINE_STATE_IDLE) | STATE_BIT(MACHINE_STATE_INITIALIZING) },
+  // MACHINE_STATE_CALIBRATING
+  { machine_calibrating_enter, machine_calibrating_tick, NULL,
+    STATE_BIT(MACHINE_STATE_IDLE) | STATE_BIT(MACHINE_STATE_INITIALIZING) }
+};
+
+/* START FUNCTION DESCRIPTION *********************
+  machine_change_state                   <machine.c>
+
+  SYNTAX: char machine_change_state( machine_t* machine_ptr, char new_state );
+
+  DESCRIPTION:
+  Moves the machine to a new state if the state
+  table allows it, running the exit handler of the
+  old state and the enter handler of the new one.
+  Changing to the current state does nothing.
+
+  PARAMETER1: The machine
+  PARAMETER2: MACHINE_STATE_ to change to
+
+  RETURN VALUE:  1 if the machine is in the new
+                 state, 0 if the change was refused
+  END DESCRIPTION ***********************************/
+char machine_change_state(machine_t* machine_ptr, char new_state) {
+  const machine_state_t* state;
+
+  if (new_state == machine_ptr->current_state) {
+    return 1;
+  }
+  if (new_state < 0 || new_state >= MACHINE_STATE_COUNT ||
+      !(machine_states[(int)machine_ptr->current_state].next & STATE_BIT(new_state))) {
+    LOG_PRINT(LOGGER_WARNING, "Refused state change from %d to %d", machine_ptr->current_state, new_state);
+    return 0;
+  }
+
+  state = &machine_states[(int)machine_ptr->current_state];
+  if (state->exit) {
+    state->exit(machine_ptr);
+  }
+  machine_ptr->current_state = new_state;
+  state = &machine_states[(int)new_state];
+  if (state->enter) {
+    state->enter(machine_ptr);
+  }
+  return 1;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  machine_request_state                  <machine.c>
+
+  SYNTAX: char machine_request_state( machine_t* machine_ptr, char new_state );
+
+  DESCRIPTION:
+  machine_change_state for requests from the HMI and
+  the keypad. Stop and home are always taken, any
+  other state only from idle.
+
+  PARAMETER1: The machine
+  PARAMETER2: MACHINE_STATE_ to change to
+
+  RETURN VALUE:  1 if the machine is in the new
+                 state, 0 if the request was refused
+  END DESCRIPTION ***********************************/
+char machine_request_state(machine_t* machine_ptr, char new_state) {
+  if (new_state != MACHINE_STATE_IDLE && new_state != MACHINE_STATE_INITIALIZING &&
+      machine_ptr->current_state != MACHINE_STATE_IDLE && new_state != machine_ptr->current_state) {
+    LOG_PRINT(LOGGER_WARNING, "Refused request for state %d in state %d", new_state, machine_ptr->current_state);
+    return 0;
+  }
+  return machine_change_state(machine_ptr, new_state);
+}
+
+// motion task, runs the current state
+void machine_process(machine_t* machine_ptr) {
+  blender_drive(&machine_ptr->blender);
+  trace_sample(&machine_ptr->blender, machine_ptr->current_state, machine_ptr->current_step);
+
+  machine_states[(int)machine_ptr->current_state].tick(machine_ptr);
+
+  boot_record_update(machine_ptr->current_state == MACHINE_STATE_IDLE && machine_ptr->blender.movement == BLENDER_MOVEMENT_IDLE,
+    machine_ptr->blender.position);
+
+  if (machine_ptr->is_initialized && !machine_ptr->ready_reported) {
+    machine_report_ready(machine_ptr);
+  }
+}
+
+// tells the HMI how long the station took from power up to usable
+void machine_report_ready(machine_t* machine_ptr) {
+  char status[32];
+
+  machine_ptr->ready_reported = 1;
+  sprintf_P(status, PSTR("Boot to ready: %lu ms"), soft_timer_now());
+  send_status(status);
+}
+
 char machine_execute_action(machine_t* machine_ptr, action_t* action) {
   switch (action->type) {
     case  ACTION_MTP:
-      return move_to_position(&machine_ptr->blender, machine_ptr->last_step_time, &action->mtp);
+      return move_to_position(&machine_ptr->blender, machine_ptr->last_step_time, &machine_ptr->step_timer, &action->mtp);
       break;
     case ACTION_WAIT:
-      return wait(&machine_ptr->blender, machine_ptr->last_step_time, &action->wait);
+      return wait(&machine_ptr->blender, &machine_ptr->step_timer, &action->wait);
       break;
     case ACTION_ACTIVATE:
       return activate(&machine_ptr->blender, &action->activate);
       break;
     case ACTION_AGITATE:
-      return agitate(&machine_ptr->blender, &action->agitate);
+      return agitate(&machine_ptr->blender, &machine_ptr->step_timer, &action->agitate);
       break;
     case ACTION_WAIT_FOR:
       return machine_wait_for(machine_ptr, &action->wait_for);
@@ -279,14 +449,13 @@ char machine_execute_action(machine_t* machine_ptr, action_t* action) {
 char machine_check_safety_conditions(machine_t* machine_ptr) {
   // TODO
   //if (machine_ptr->current_state == MACHINE_STATE_CLEANING || machine_ptr->current_state == MACHINE_STATE_BLENDING) { 
-  if (machine_ptr->current_state == MACHINE_STATE_CLEANING) {    
+  if (machine_ptr->current_state == MACHINE_STATE_CLEANING || machine_ptr->current_state == MACHINE_STATE_CALIBRATING) {
     if (machine_ptr->cup_detect_reading < 8) {
       // something is in the machine
-      machine_ptr->current_state = MACHINE_STATE_IDLE;
       LOG_PRINT(LOGGER_ERROR, "SAFETY TIGGERED");
-      machine_stop(machine_ptr);
+      machine_change_state(machine_ptr, MACHINE_STATE_IDLE);
       //led check    
-      digitalWrite(13, HIGH);  
+      outputs_write(OUTPUT_STATUS_LED, HIGH);
     }
   }
   // to blink led
@@ -302,12 +471,40 @@ char machine_check_safety_conditions(machine_t* machine_ptr) {
 
 void machine_stop(machine_t* machine_prt) {
   // turn off blender and pump!!
-  digitalWrite(PUMP_ADDRESS, HIGH);
-  digitalWrite(BLENDER_ADDRESS, LOW);
+  outputs_write(OUTPUT_PUMP, HIGH);
+  outputs_write(OUTPUT_BLENDER, LOW);
+}
+
+// any keypad button held, or one toggled from the HMI
+char machine_buttons_pressed(machine_t* machine_ptr) {
+  char i;
+
+  for (i = 0; i < BUTTON_COUNT; i++) {
+    if (machine_ptr->buttons[(int)i].current_state) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// nothing going on that needs the full task rates
+char machine_at_rest(machine_t* machine_ptr) {
+  return machine_ptr->current_state == MACHINE_STATE_IDLE &&
+    machine_ptr->blender.movement == BLENDER_MOVEMENT_IDLE &&
+    !machine_buttons_pressed(machine_ptr);
+}
+
+// the current step starts again from now, the wait or move timeout is
+// started on the step's first call
+void machine_restart_step(machine_t* machine_ptr) {
+  machine_ptr->last_step_time = soft_timer_now();
+  soft_timer_stop(&machine_ptr->step_timer);
 }
 
 char machine_wait_for(machine_t* machine_ptr, action_wait_for_t* wait_for) {
-  LOG_PRINT(LOGGER_VERBOSE, "waiting for T:%d C:%d R:%d V%d", wait_for->type, wait_for->comparer, machine_ptr->cup_detect_reading, wait_for->value);
+  // called every pass until the cup is there, the reading changes too
+  // often for the repeats to fold
+  LOG_PRINT_INTERVAL(LOGGER_VERBOSE, 250, "waiting for T:%d C:%d R:%d V%d", wait_for->type, wait_for->comparer, machine_ptr->cup_detect_reading, wait_for->value);
   switch (wait_for->type) {
     case WAIT_FOR_CUP_IN_PLACE:
       switch (wait_for->comparer) {
@@ -328,143 +525,238 @@ char machine_wait_for(machine_t* machine_ptr, action_wait_for_t* wait_for) {
           break;
       }
       break;
+    case WAIT_FOR_CUP_STATE:
+      return machine_ptr->cup_filter.cup_present == wait_for->value;
   }
 
   return false;
 }
 
 void machine_check_for_jams(machine_t* machine_ptr) {
+  int velocity, stall_velocity;
+  char direction = blend_sequence.actions_ptr[machine_ptr->current_step].mtp.move_direction;
+
   // we we are supposed to be moving, let's validate that we are actually moving
   if (blend_sequence.actions_ptr[machine_ptr->current_step].mtp.new_position == TOP_POSITION) {return;}
-  if (machine_ptr->last_jam_check_time + 800 < millis()) { //+500 jam react time: number bigger means actuator will keep going for longer time
-    int where_should_we_be = 0;
-    //blend_sequence.jam_counter_total = 0; // add for count the totoal jam, because the shake function in jam should not work for the first 3 times.
 
+  // judge every velocity sample once, and give the motor time to get going
+  if (machine_ptr->blender.velocity_sample == machine_ptr->last_stall_sample) {return;}
+  machine_ptr->last_stall_sample = machine_ptr->blender.velocity_sample;
+  if (soft_timer_now() - machine_ptr->last_step_time < JAM_BLANKING_TIME) {
+    machine_ptr->stall_samples = 0;
+    return;
+  }
+
+  // velocity in the commanded direction, anything well below what the
+  // speed model expects for the PWM being applied counts as a stalled sample
+  velocity = (direction == BLENDER_MOVEMENT_DOWN) ? machine_ptr->blender.velocity : -machine_ptr->blender.velocity;
+  stall_velocity = speed_model_velocity(direction, machine_ptr->blender.duty) / JAM_STALL_FRACTION;
+  if (stall_velocity < JAM_STALL_VELOCITY) {
+    stall_velocity = JAM_STALL_VELOCITY;
+  }
+
+  if (velocity > stall_velocity) {
+    machine_ptr->stall_samples = 0;
+    return;
+  }
+
+  // a slowdown is enough to keep the blend from ending early
+  machine_ptr->clean_moves = 0;
 
-    switch (blend_sequence.actions_ptr[machine_ptr->current_step].mtp.move_direction) {
-      // change to ABS calc instead of switch
+  if (++machine_ptr->stall_samples >= JAM_STALL_SAMPLES) {
+    machine_ptr->stall_samples = 0;
+    if (machine_ptr->blend_jams < BLEND_EXTEND_JAMS) {
+      machine_ptr->blend_jams++;
+    }
+    // the recovery goes in the steps before this one, it runs again after
+    machine_ptr->recovery_end = machine_ptr->current_step;
+    // the recovery waits are timed from the moment the jam is declared
+    machine_restart_step(machine_ptr);
+
+    switch (direction) {
       case BLENDER_MOVEMENT_UP:
-          where_should_we_be = machine_ptr->last_jam_check_position - 2;
-          if (where_should_we_be < machine_ptr->blender.position) {
-            // JAMMED
-            LOG_PRINT(LOGGER_ERROR, "Jammed moving up: should be:%d is:%d", where_should_we_be, machine_ptr->blender.position);
-            blend_sequence.actions_ptr[machine_ptr->current_step - 4].type = ACTION_WAIT;
-            blend_sequence.actions_ptr[machine_ptr->current_step - 4].wait.time_to_wait = 750; //ms
-
-            blend_sequence.actions_ptr[machine_ptr->current_step - 3].type = ACTION_MTP;
-            blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.new_position = (machine_ptr->blender.position + 50 > BOTTOM_OF_CUP) ? BOTTOM_OF_CUP : machine_ptr->blender.position + 50; // position
-            blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
-            blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.time_out = 3000;
-            blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.speed = MOTOR_SPEED_FULL;// MOTOR_SPEED_HALF
-            
-            blend_sequence.actions_ptr[machine_ptr->current_step - 2].type = ACTION_ACTIVATE;
-            blend_sequence.actions_ptr[machine_ptr->current_step - 2].activate.address = BLENDER_SPEED_ADDRESS;
-            blend_sequence.actions_ptr[machine_ptr->current_step - 2].activate.state = ON;
-            
-            blend_sequence.actions_ptr[machine_ptr->current_step - 1].type = ACTION_WAIT;
-            blend_sequence.actions_ptr[machine_ptr->current_step - 1].wait.time_to_wait = 2000; //ms
-            machine_ptr->current_step = machine_ptr->current_step - 4;
-          }
+          // JAMMED
+          LOG_PRINT(LOGGER_ERROR, "Jammed moving up: velocity:%d is:%d", velocity, machine_ptr->blender.position);
+          blend_sequence.actions_ptr[machine_ptr->current_step - 4].type = ACTION_WAIT;
+          blend_sequence.actions_ptr[machine_ptr->current_step - 4].wait.time_to_wait = 750; //ms
+
+          blend_sequence.actions_ptr[machine_ptr->current_step - 3].type = ACTION_MTP;
+          blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.new_position = (machine_ptr->blender.position + POSITION(50) > BOTTOM_OF_CUP) ? BOTTOM_OF_CUP : machine_ptr->blender.position + POSITION(50); // position
+          blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
+          blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.time_out = 3000;
+          blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.speed = MOTOR_SPEED_FULL;// MOTOR_SPEED_HALF
+          blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.travel_time = 0;
+          
+          blend_sequence.actions_ptr[machine_ptr->current_step - 2].type = ACTION_ACTIVATE;
+          blend_sequence.actions_ptr[machine_ptr->current_step - 2].activate.address = BLENDER_SPEED_ADDRESS;
+          blend_sequence.actions_ptr[machine_ptr->current_step - 2].activate.state = ON;
+          
+          blend_sequence.actions_ptr[machine_ptr->current_step - 1].type = ACTION_WAIT;
+          blend_sequence.actions_ptr[machine_ptr->current_step - 1].wait.time_to_wait = 2000; //ms
+          machine_ptr->current_step = machine_ptr->current_step - 4;
         break;
       case BLENDER_MOVEMENT_DOWN:
-          if ((machine_ptr->last_jam_check_position + 5) > machine_ptr->blender.position) {
-            where_should_we_be = machine_ptr->last_jam_check_position;
-            if (abs(machine_ptr->blender.position - where_should_we_be) <=  5) {  //3 more sensitive for smaller number
-              jam_counter +=1;
-              blend_sequence.jam_counter_total +=1;
-              LOG_PRINT(LOGGER_ERROR, "jam_counter:%d", jam_counter);
-              //LOG_PRINT(LOGGER_ERROR, "jam_counter_total:%d", blend_sequence.jam_counter_total);
-            }
-            else{
-              jam_counter -=1;
-              blend_sequence.jam_counter_total -=1;
-            }
-
+          jam_counter +=1;
+          blend_sequence.jam_counter_total +=1;
+          LOG_PRINT(LOGGER_ERROR, "jam_counter:%d", jam_counter);
+          //LOG_PRINT(LOGGER_ERROR, "jam_counter_total:%d", blend_sequence.jam_counter_total);
+
+          LOG_PRINT(LOGGER_ERROR, "Jammed moving down: velocity:%d is:%d", velocity, machine_ptr->blender.position);
+          blend_sequence.actions_ptr[machine_ptr->current_step - 4].type = ACTION_ACTIVATE;
+          blend_sequence.actions_ptr[machine_ptr->current_step - 4].activate.address = BLENDER_SPEED_ADDRESS;
+          blend_sequence.actions_ptr[machine_ptr->current_step - 4].activate.state = ON; //OFF
+
+          blend_sequence.actions_ptr[machine_ptr->current_step - 4].type = ACTION_WAIT;
+          blend_sequence.actions_ptr[machine_ptr->current_step - 4].wait.time_to_wait = 250; //ms 750, 1250
+
+          blend_sequence.actions_ptr[machine_ptr->current_step - 3].type = ACTION_MTP;           
+          blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.new_position = machine_ptr->blender.position - POSITION(30); // position
+          blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.move_direction = BLENDER_MOVEMENT_UP;
+          blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.time_out = 3000;
+          blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.speed = MOTOR_SPEED_FULL; //half
+          blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.travel_time = 0;
             
+          blend_sequence.actions_ptr[machine_ptr->current_step - 2].type = ACTION_WAIT;
+          blend_sequence.actions_ptr[machine_ptr->current_step - 2].wait.time_to_wait = 250; //ms
 
-            LOG_PRINT(LOGGER_ERROR, "Jammed moving down: should be:%d is:%d", where_should_we_be, machine_ptr->blender.position);
-            blend_sequence.actions_ptr[machine_ptr->current_step - 4].type = ACTION_ACTIVATE;
-            blend_sequence.actions_ptr[machine_ptr->current_step - 4].activate.address = BLENDER_SPEED_ADDRESS;
-            blend_sequence.actions_ptr[machine_ptr->current_step - 4].activate.state = ON; //OFF
-
-            blend_sequence.actions_ptr[machine_ptr->current_step - 4].type = ACTION_WAIT;
-            blend_sequence.actions_ptr[machine_ptr->current_step - 4].wait.time_to_wait = 250; //ms 750, 1250
+          blend_sequence.actions_ptr[machine_ptr->current_step - 1].type = ACTION_WAIT;
+          blend_sequence.actions_ptr[machine_ptr->current_step - 1].wait.time_to_wait = 250; //ms
 
-            blend_sequence.actions_ptr[machine_ptr->current_step - 3].type = ACTION_MTP;           
-            blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.new_position = machine_ptr->blender.position - 30; // position
-            blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.move_direction = BLENDER_MOVEMENT_UP;
-            blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.time_out = 3000;
-            blend_sequence.actions_ptr[machine_ptr->current_step - 3].mtp.speed = MOTOR_SPEED_FULL; //half
-              
-            blend_sequence.actions_ptr[machine_ptr->current_step - 2].type = ACTION_WAIT;
-            blend_sequence.actions_ptr[machine_ptr->current_step - 2].wait.time_to_wait = 250; //ms
+          machine_ptr->current_step = machine_ptr->current_step - 4;
 
-            blend_sequence.actions_ptr[machine_ptr->current_step - 1].type = ACTION_WAIT;
-            blend_sequence.actions_ptr[machine_ptr->current_step - 1].wait.time_to_wait = 250; //ms
+          
+          
+          if(jam_counter == 3)
+          {
+            if(machine_ptr->blender.position > POSITION(540)){
+            
+              for (int j = 0; j < 2; j++) {
+                //votex
+                blend_sequence.actions_ptr[machine_ptr->current_step - 4].type = ACTION_MTP;
+                blend_sequence.actions_ptr[machine_ptr->current_step - 4].mtp.new_position = machine_ptr->blender.position - POSITION(60); // position TOP_OF_CUP ,TOP_OF_SMOOTHIE  + 50
+                blend_sequence.actions_ptr[machine_ptr->current_step - 4].mtp.move_direction = BLENDER_MOVEMENT_UP;
+                blend_sequence.actions_ptr[machine_ptr->current_step - 4].mtp.time_out = 3000;
+                blend_sequence.actions_ptr[machine_ptr->current_step - 4].mtp.speed = MOTOR_SPEED_FULL;
+                blend_sequence.actions_ptr[machine_ptr->current_step - 4].mtp.travel_time = 0;
 
-            machine_ptr->current_step = machine_ptr->current_step - 4;
 
-            
-            
-            if(jam_counter == 3)
-            {
-              if(machine_ptr->blender.position > 540){
-              
-                for (int j = 0; j < 2; j++) {
-                  //votex
-                  blend_sequence.actions_ptr[machine_ptr->current_step - 4].type = ACTION_MTP;
-                  blend_sequence.actions_ptr[machine_ptr->current_step - 4].mtp.new_position = machine_ptr->blender.position - 60; // position TOP_OF_CUP ,TOP_OF_SMOOTHIE  + 50
-                  blend_sequence.actions_ptr[machine_ptr->current_step - 4].mtp.move_direction = BLENDER_MOVEMENT_UP;
-                  blend_sequence.actions_ptr[machine_ptr->current_step - 4].mtp.time_out = 3000;
-                  blend_sequence.actions_ptr[machine_ptr->current_step - 4].mtp.speed = MOTOR_SPEED_FULL;
-
-
-                  blend_sequence.actions_ptr[machine_ptr->current_step - 3].type = ACTION_WAIT;
-                  blend_sequence.actions_ptr[machine_ptr->current_step - 3].wait.time_to_wait = 350; //ms
-
-                  blend_sequence.actions_ptr[machine_ptr->current_step - 2].type = ACTION_MTP;
-                  blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.new_position = machine_ptr->blender.position - 5; // position TOP_OF_CUP - 20, TOP_OF_SMOOTHIE  + 45
-                  blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
-                  blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.time_out = 3000;
-                  blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.speed = MOTOR_SPEED_QUARTER;
-
-                  
-                  blend_sequence.actions_ptr[machine_ptr->current_step - 1].type = ACTION_WAIT;
-                  blend_sequence.actions_ptr[machine_ptr->current_step - 1].wait.time_to_wait = 350; //ms
-
-                  machine_ptr->current_step = machine_ptr->current_step - 4;
-                }
-              }
-              
-              else{
                 blend_sequence.actions_ptr[machine_ptr->current_step - 3].type = ACTION_WAIT;
                 blend_sequence.actions_ptr[machine_ptr->current_step - 3].wait.time_to_wait = 350; //ms
 
-              
-                blend_sequence.actions_ptr[machine_ptr->current_step - 2].type = ACTION_MTP;           
-                blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.new_position = TOP_OF_SMOOTHIE + 45; // position  TOP_OF_SMOOTHIE 30
-                blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.move_direction = BLENDER_MOVEMENT_UP;
+                blend_sequence.actions_ptr[machine_ptr->current_step - 2].type = ACTION_MTP;
+                blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.new_position = machine_ptr->blender.position - POSITION(5); // position TOP_OF_CUP - 20, TOP_OF_SMOOTHIE  + 45
+                blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.move_direction = BLENDER_MOVEMENT_DOWN;
                 blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.time_out = 3000;
-                blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.speed = MOTOR_SPEED_FULL; //half
+                blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.speed = MOTOR_SPEED_QUARTER;
+                blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.travel_time = 0;
 
+                
                 blend_sequence.actions_ptr[machine_ptr->current_step - 1].type = ACTION_WAIT;
-                blend_sequence.actions_ptr[machine_ptr->current_step - 1].wait.time_to_wait = 100; //ms
-                machine_ptr->current_step = machine_ptr->current_step - 3;
-              }
-              
+                blend_sequence.actions_ptr[machine_ptr->current_step - 1].wait.time_to_wait = 350; //ms
 
-              jam_counter = 0;
+                machine_ptr->current_step = machine_ptr->current_step - 4;
+              }
             }
+            
+            else{
+              blend_sequence.actions_ptr[machine_ptr->current_step - 3].type = ACTION_WAIT;
+              blend_sequence.actions_ptr[machine_ptr->current_step - 3].wait.time_to_wait = 350; //ms
 
+            
+              blend_sequence.actions_ptr[machine_ptr->current_step - 2].type = ACTION_MTP;           
+              blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.new_position = TOP_OF_SMOOTHIE + POSITION(45); // position  TOP_OF_SMOOTHIE 30
+              blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.move_direction = BLENDER_MOVEMENT_UP;
+              blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.time_out = 3000;
+              blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.speed = MOTOR_SPEED_FULL; //half
+              blend_sequence.actions_ptr[machine_ptr->current_step - 2].mtp.travel_time = 0;
+
+              blend_sequence.actions_ptr[machine_ptr->current_step - 1].type = ACTION_WAIT;
+              blend_sequence.actions_ptr[machine_ptr->current_step - 1].wait.time_to_wait = 100; //ms
+              machine_ptr->current_step = machine_ptr->current_step - 3;
+            }
+            
 
+            jam_counter = 0;
           }
 
 
+
+
           
           break;
     }
-    machine_ptr->last_jam_check_position = machine_ptr->blender.position;
-    machine_ptr->last_jam_check_time = millis();
   }
 }
 
+// called after every completed blend step. Ends the stir/lift loops early
+// once enough moves in a row went through cleanly, and repeats the last
+// block of loops while jams keep coming, within the blend time bounds
+void machine_adapt_blend(machine_t* machine_ptr, char completed_type) {
+  int step = machine_ptr->current_step;
+  unsigned long blend_time = soft_timer_now() - machine_ptr->blend_start_time;
+  action_activate_t blade_on;
+
+  // each block of loops has to earn its own clean window. Only the first
+  // entry counts, a jam rewinds through the block start and must not
+  // clear the jams it just counted or restart the blend time
+  if (step == blend_sequence.stir_start && machine_ptr->blend_block < BLEND_BLOCK_STIR) {
+    machine_ptr->blend_block = BLEND_BLOCK_STIR;
+    machine_ptr->blend_start_time = soft_timer_now();
+    machine_ptr->clean_moves = 0;
+    machine_ptr->blend_jams = 0;
+    return;
+  }
+  if (step == blend_sequence.stir_resume && machine_ptr->blend_block < BLEND_BLOCK_RESUME) {
+    machine_ptr->blend_block = BLEND_BLOCK_RESUME;
+    machine_ptr->clean_moves = 0;
+    machine_ptr->blend_jams = 0;
+    return;
+  }
+
+  // nothing to adapt outside the loops or while refilling
+  if (step < blend_sequence.stir_start || step > blend_sequence.stir_end ||
+      (step > blend_sequence.refill_start && step < blend_sequence.stir_resume)) {
+    return;
+  }
+
+  // the backoff moves of a jam recovery are not recipe moves, counting
+  // starts again with the move that jammed once it has gone through
+  if (step > machine_ptr->recovery_end) {
+    machine_ptr->recovery_end = 0;
+    if (completed_type == ACTION_MTP && machine_ptr->clean_moves < BLEND_CLEAN_MOVES) {
+      machine_ptr->clean_moves++;
+    }
+  }
+
+  if (step == blend_sequence.stir_end) {
+    if (machine_ptr->blend_jams >= BLEND_EXTEND_JAMS && blend_time < BLEND_MAX_TIME) {
+      LOG_PRINT(LOGGER_INFO, "Extending blend, blend time:%ds", (int)(blend_time / 1000));
+      // the block is run again as written in the recipe, not with the
+      // steps jam recovery put in its place
+      blend_refill_actions_init();
+      machine_ptr->current_step = blend_sequence.stir_resume;
+      machine_ptr->recovery_end = 0;
+      machine_ptr->clean_moves = 0;
+      machine_ptr->blend_jams = 0;
+    }
+    return;
+  }
+
+  // the block after the refill always mixes the new liquid in, it is
+  // only BLEND_CLEAN_MOVES moves long so there is nothing to cut short
+  if (step >= blend_sequence.refill_start) {
+    return;
+  }
+
+  if ((machine_ptr->clean_moves >= BLEND_CLEAN_MOVES && blend_time >= BLEND_MIN_TIME) ||
+      blend_time >= BLEND_MAX_TIME) {
+    LOG_PRINT(LOGGER_INFO, "Ending stir loops early at step %d, blend time:%ds", step, (int)(blend_time / 1000));
+    machine_ptr->current_step = blend_sequence.refill_start;
+
+    // the skipped loops may have left the blade off, the normal flow
+    // always has it running through the refill and the last block
+    blade_on.address = BLENDER_ADDRESS;
+    blade_on.state = ON;
+    activate(&machine_ptr->blender, &blade_on);
+  }
+}
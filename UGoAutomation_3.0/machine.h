@@ -7,6 +7,10 @@
 #include "liquid_filling.h"
 #include "input_button.h"
 #include "NewPingCWrapper.h"
+#include "speed_model.h"
+#include "boot_record.h"
+#include "trace.h"
+#include "cup_filter.h"
 
 #define BUTTON_COUNT 9
 #define BLEND_BUTTON 0
@@ -19,28 +23,81 @@
 #define REBLEND_BUTTON 7
 #define JOG_PUMP_BUTTON 8
 
+// a move is jammed after JAM_STALL_SAMPLES velocity samples in a row below
+// the stall velocity, which is the expected velocity for the commanded PWM
+// divided by JAM_STALL_FRACTION but never less than JAM_STALL_VELOCITY
+#define JAM_STALL_SAMPLES 4
+#define JAM_STALL_FRACTION 4
+#define JAM_STALL_VELOCITY POSITION(15) // counts per second
+#define JAM_BLANKING_TIME 250 // ms after a move starts before checking
+
+// the stir/lift loops end early once BLEND_CLEAN_MOVES moves in a row ran
+// without a jam or stalled sample, but never before BLEND_MIN_TIME. The last
+// block repeats while it sees BLEND_EXTEND_JAMS jams, up to BLEND_MAX_TIME.
+// Only the loops before the refill end early, the block after it has just
+// BLEND_CLEAN_MOVES moves and always runs to the end to mix the new liquid in
+#define BLEND_CLEAN_MOVES 4
+#define BLEND_EXTEND_JAMS 2
+#define BLEND_MIN_TIME 10000 // ms from the start of the stir loops
+#define BLEND_MAX_TIME 40000
+
+// blocks of loops for machine_t.blend_block, in sequence order
+#define BLEND_BLOCK_NONE 0
+#define BLEND_BLOCK_STIR 1
+#define BLEND_BLOCK_RESUME 2
+
 typedef struct {
   char id;
   char is_initialized;
+  char ready_reported;
   char current_state;
   char cuurent_cycle_type;
-  char current_step;
+  unsigned char current_step;
   blender_t blender;
   liquid_filler_t liquid_filler;
   unsigned long last_step_time;
-  unsigned long last_jam_check_time;
-  int last_jam_check_position;
+  /* times the wait and move timeout of the current step */
+  soft_timer_t step_timer;
+  char stall_samples;
+  unsigned char last_stall_sample;
+  unsigned long blend_start_time;
+  char clean_moves;
+  char blend_jams;
+  /* step that jammed, the moves before it are recovery and not counted */
+  unsigned char recovery_end;
+  /* last block of loops entered going forward, see machine_adapt_blend */
+  char blend_block;
   int cup_detect_reading;
+  cup_filter_t cup_filter;
   CNewPing* cup_detect_sensor;
   input_button_t buttons[BUTTON_COUNT];
-  unsigned long last_cup_read_time;
+  input_debounce_t debounce;
   char keypad_enabled;
+  speed_model_calibration_t calibration;
 } machine_t;
 
+typedef void (* MACHINE_HANDLER)(machine_t*);
+
+typedef struct {
+  MACHINE_HANDLER enter;
+  MACHINE_HANDLER tick;
+  MACHINE_HANDLER exit;
+  /* bit n set if MACHINE_STATE n may follow */
+  unsigned char next;
+} machine_state_t;
+
 void machine_init(machine_t*);
+void machine_update_position(machine_t*);
+void machine_read_sonar(machine_t*);
+void machine_read_inputs(machine_t*);
 void machine_process(machine_t*);
-void machine_change_state(machine_t*);
+char machine_change_state(machine_t*, char);
+char machine_request_state(machine_t*, char);
 void machine_stop(machine_t*);
+void machine_restart_step(machine_t*);
+void machine_report_ready(machine_t*);
+char machine_buttons_pressed(machine_t*);
+char machine_at_rest(machine_t*);
 
 char machine_execute_action(machine_t*, action_t*);
 
@@ -49,6 +106,7 @@ char machine_check_safety_conditions(machine_t*);
 char machine_wait_for(machine_t*, action_wait_for_t*);
 
 void machine_check_for_jams(machine_t*);
+void machine_adapt_blend(machine_t*, char);
 
 #endif
 
@@ -21,9 +21,10 @@
 *
 * SM040716
 ***************************************************/
+#define LOG_FILE_ID 6
 #include "mediator.h"
 
-#define MAX_EVENTS 10
+#define MAX_EVENTS 21
 #define MAX_ACTIONS_PER_EVENT 10
 
 typedef struct 
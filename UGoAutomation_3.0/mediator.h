@@ -13,6 +13,17 @@
 #define MEDIATOR_JOG_BOTTOM 7
 #define MEDIATOR_REBLEND 8
 #define MEDIATOR_DISABLE_KEYPAD 9
+#define MEDIATOR_CALIBRATE_SPEED 10
+#define MEDIATOR_TRACE_ARM 11
+#define MEDIATOR_TRACE_DUMP 12
+#define MEDIATOR_SCHEDULER_REPORT 13
+#define MEDIATOR_PROFILE_REPORT 14
+#define MEDIATOR_PROFILE_RESET 15
+#define MEDIATOR_GET_OUTPUTS 16
+#define MEDIATOR_TOGGLE_OUTPUT 17
+#define MEDIATOR_POWER_REPORT 18
+#define MEDIATOR_MEMORY_REPORT 19
+#define MEDIATOR_UART_STATS 20
 
 typedef void (* ACTION_PTR)(char*);
 
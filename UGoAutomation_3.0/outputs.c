@@ -0,0 +1,227 @@
+/***************************************************
+  Outputs                                <outputs.c>
+
+  Keeps a shadow of every station output and only
+  touches the hardware when a value changes, so the
+  state machine can state what it wants on every
+  pass without rewriting the pins each time.
+
+  All output writes have to go through here or the
+  shadow goes stale and a later write of the same
+  value would be skipped.
+
+  Usage example:
+  outputs_write(OUTPUT_PUMP, HIGH);
+***************************************************/
+#include "outputs.h"
+
+static unsigned char outputs_shadow[OUTPUTS_COUNT];
+static unsigned long outputs_writes;
+static unsigned long outputs_suppressed;
+
+static void outputs_write_hardware(char output, unsigned char value) {
+  switch (output) {
+    case OUTPUT_BLENDER: PIN_WRITE(BLENDER, value); break;
+    case OUTPUT_PUMP: PIN_WRITE(PUMP, value); break;
+    case OUTPUT_LIQUID_FILLING_VALVE: PIN_WRITE(LIQUID_FILLING_VALVE, value); break;
+    case OUTPUT_CLEANING_VALVE: PIN_WRITE(CLEANING_VALVE, value); break;
+    case OUTPUT_BLENDER_SPEED: PIN_WRITE(BLENDER_SPEED, value); break;
+    case OUTPUT_ACTUATOR_UP_ENABLED: PIN_WRITE(ACTUATOR_UP_ENABLED, value); break;
+    case OUTPUT_ACTUATOR_DOWN_ENABLED: PIN_WRITE(ACTUATOR_DOWN_ENABLED, value); break;
+    case OUTPUT_STATUS_LED: PIN_WRITE(STATUS_LED, value); break;
+    case OUTPUT_ACTUATOR_UP: PWM_WRITE(ACTUATOR_UP, value); break;
+    case OUTPUT_ACTUATOR_DOWN: PWM_WRITE(ACTUATOR_DOWN, value); break;
+  }
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  outputs_init                           <outputs.c>
+
+  SYNTAX: void outputs_init( void );
+
+  DESCRIPTION:
+  Makes every output a pin output and writes its
+  power up state. The relays are active low, so the
+  pump, valves and speed relay start high (off). The
+  actuator drivers are enabled and not driven.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void outputs_init() {
+  char i;
+
+  pinMode(BLENDER_ADDRESS, OUTPUT);
+  pinMode(PUMP_ADDRESS, OUTPUT);
+  pinMode(LIQUID_FILLING_VALVE_ADDRESS, OUTPUT);
+  pinMode(CLEANING_VALVE_ADDRESS, OUTPUT);
+  pinMode(BLENDER_SPEED_ADDRESS, OUTPUT);
+  pinMode(ACTUATOR_UP_ENABLED_ADDRESS, OUTPUT);
+  pinMode(ACTUATOR_DOWN_ENABLED_ADDRESS, OUTPUT);
+  pinMode(STATUS_LED_ADDRESS, OUTPUT);
+  pinMode(ACTUATOR_UP_ADDRESS, OUTPUT);
+  pinMode(ACTUATOR_DOWN_ADDRESS, OUTPUT);
+
+  outputs_shadow[OUTPUT_BLENDER] = LOW;
+  outputs_shadow[OUTPUT_PUMP] = HIGH;
+  outputs_shadow[OUTPUT_LIQUID_FILLING_VALVE] = HIGH;
+  outputs_shadow[OUTPUT_CLEANING_VALVE] = HIGH;
+  outputs_shadow[OUTPUT_BLENDER_SPEED] = HIGH;
+  outputs_shadow[OUTPUT_ACTUATOR_UP_ENABLED] = HIGH;
+  outputs_shadow[OUTPUT_ACTUATOR_DOWN_ENABLED] = HIGH;
+  outputs_shadow[OUTPUT_STATUS_LED] = LOW;
+  outputs_shadow[OUTPUT_ACTUATOR_UP] = 0;
+  outputs_shadow[OUTPUT_ACTUATOR_DOWN] = 0;
+
+  for (i = 0; i < OUTPUTS_COUNT; i++) {
+    outputs_write_hardware(i, outputs_shadow[(int)i]);
+  }
+  outputs_writes = OUTPUTS_COUNT;
+  outputs_suppressed = 0;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  outputs_write                          <outputs.c>
+
+  SYNTAX: void outputs_write( char output, unsigned char value );
+
+  DESCRIPTION:
+  Sets an output, the pin is only written when the
+  value is different from the last one written.
+
+  PARAMETER1: OUTPUT_ index
+  PARAMETER2: HIGH/LOW, or the duty of PWM outputs
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void outputs_write(char output, unsigned char value) {
+  if (output < 0 || output >= OUTPUTS_COUNT) {
+    return;
+  }
+
+  if (outputs_shadow[(int)output] == value) {
+    outputs_suppressed++;
+    return;
+  }
+
+  outputs_shadow[(int)output] = value;
+  outputs_writes++;
+  outputs_write_hardware(output, value);
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  outputs_read                           <outputs.c>
+
+  SYNTAX: unsigned char outputs_read( char output );
+
+  DESCRIPTION:
+  The last value written to an output.
+
+  PARAMETER1: OUTPUT_ index
+
+  RETURN VALUE:  the value, 0 for an unknown output
+  END DESCRIPTION ***********************************/
+unsigned char outputs_read(char output) {
+  if (output < 0 || output >= OUTPUTS_COUNT) {
+    return 0;
+  }
+  return outputs_shadow[(int)output];
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  outputs_index                          <outputs.c>
+
+  SYNTAX: char outputs_index( char address );
+
+  DESCRIPTION:
+  Finds the output on a pin, recipes and the HMI
+  refer to outputs by pin number.
+
+  PARAMETER1: The pin number
+
+  RETURN VALUE:  the OUTPUT_ index, -1 if the pin is
+                 not a station output
+  END DESCRIPTION ***********************************/
+char outputs_index(char address) {
+  switch (address) {
+    case BLENDER_ADDRESS: return OUTPUT_BLENDER;
+    case PUMP_ADDRESS: return OUTPUT_PUMP;
+    case LIQUID_FILLING_VALVE_ADDRESS: return OUTPUT_LIQUID_FILLING_VALVE;
+    case CLEANING_VALVE_ADDRESS: return OUTPUT_CLEANING_VALVE;
+    case BLENDER_SPEED_ADDRESS: return OUTPUT_BLENDER_SPEED;
+    case ACTUATOR_UP_ENABLED_ADDRESS: return OUTPUT_ACTUATOR_UP_ENABLED;
+    case ACTUATOR_DOWN_ENABLED_ADDRESS: return OUTPUT_ACTUATOR_DOWN_ENABLED;
+    case STATUS_LED_ADDRESS: return OUTPUT_STATUS_LED;
+    case ACTUATOR_UP_ADDRESS: return OUTPUT_ACTUATOR_UP;
+    case ACTUATOR_DOWN_ADDRESS: return OUTPUT_ACTUATOR_DOWN;
+  }
+  return -1;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  outputs_write_address                  <outputs.c>
+
+  SYNTAX: void outputs_write_address( char address, char value );
+
+  DESCRIPTION:
+  outputs_write by pin number. Pins that are not
+  station outputs are written with digitalWrite.
+
+  PARAMETER1: The pin number
+  PARAMETER2: HIGH/LOW
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void outputs_write_address(char address, char value) {
+  char output = outputs_index(address);
+
+  if (output < 0) {
+    digitalWrite(address, value);
+    return;
+  }
+  outputs_write(output, value ? HIGH : LOW);
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  outputs_toggle_address                 <outputs.c>
+
+  SYNTAX: void outputs_toggle_address( char address );
+
+  DESCRIPTION:
+  Inverts a digital output, used by the HMI to
+  test the wiring.
+
+  PARAMETER1: The pin number
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void outputs_toggle_address(char address) {
+  char output = outputs_index(address);
+
+  if (output < 0) {
+    digitalWrite(address, !digitalRead(address));
+    return;
+  }
+  outputs_write(output, outputs_read(output) ? LOW : HIGH);
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  outputs_report                         <outputs.c>
+
+  SYNTAX: void outputs_report( void );
+
+  DESCRIPTION:
+  Sends a MSG_GET_ACTUATOR_STATE with the state of
+  every output.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void outputs_report() {
+  hmi_message_t msg;
+  outputs_snapshot_t* snapshot = (outputs_snapshot_t*)msg.payload;
+
+  msg.message_id = MSG_GET_ACTUATOR_STATE;
+  memcpy(snapshot->state, outputs_shadow, OUTPUTS_COUNT);
+  snapshot->writes = outputs_writes;
+  snapshot->suppressed = outputs_suppressed;
+  c_send_message(msg, sizeof(outputs_snapshot_t));
+}
@@ -0,0 +1,35 @@
+#ifndef OUTPUTS_H
+#define OUTPUTS_H
+
+#include "global.h"
+#include "pins.h"
+
+#define OUTPUT_BLENDER 0
+#define OUTPUT_PUMP 1
+#define OUTPUT_LIQUID_FILLING_VALVE 2
+#define OUTPUT_CLEANING_VALVE 3
+#define OUTPUT_BLENDER_SPEED 4
+#define OUTPUT_ACTUATOR_UP_ENABLED 5
+#define OUTPUT_ACTUATOR_DOWN_ENABLED 6
+#define OUTPUT_STATUS_LED 7
+// PWM, the value is the duty
+#define OUTPUT_ACTUATOR_UP 8
+#define OUTPUT_ACTUATOR_DOWN 9
+#define OUTPUTS_COUNT 10
+
+typedef struct __attribute__((__packed__, aligned(1))) {
+  unsigned char state[OUTPUTS_COUNT];
+  /* hardware writes and writes skipped as unchanged since boot */
+  unsigned long writes;
+  unsigned long suppressed;
+} outputs_snapshot_t;
+
+void outputs_init();
+void outputs_write(char, unsigned char);
+unsigned char outputs_read(char);
+char outputs_index(char);
+void outputs_write_address(char, char);
+void outputs_toggle_address(char);
+void outputs_report();
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef PINS_H
+#define PINS_H
+
+/***************************************************
+  Pin map of the station outputs. Every output has
+  an Arduino pin number, X_ADDRESS, and on the Mega
+  2560 its port, input register and bit as well, so
+  PIN_SET(X), PIN_CLEAR(X) and PIN_READ(X) compile
+  to direct port operations (a single sbi/cbi on
+  ports A-G). Other boards fall back to digitalWrite
+  and digitalRead.
+
+  The actuator pins are PWM, PWM_WRITE(X, duty) sets
+  the timer compare register directly.
+
+  Write the outputs through outputs.c, which keeps
+  a shadow of them, rather than with these directly.
+
+  No interrupt writes to these ports, so the read-
+  modify-write on ports H and L is safe.
+
+  The map is fixed to the station wiring, the
+  port, register and bit of each pin below must be
+  changed along with its number.
+***************************************************/
+
+#include "Arduino.h"
+#include <avr/io.h>
+
+#define BLENDER_ADDRESS 9
+#define PUMP_ADDRESS 51
+#define LIQUID_FILLING_VALVE_ADDRESS 49
+#define CLEANING_VALVE_ADDRESS 53
+#define BLENDER_SPEED_ADDRESS 35
+#define ACTUATOR_UP_ADDRESS 3
+#define ACTUATOR_DOWN_ADDRESS 4
+#define ACTUATOR_UP_ENABLED_ADDRESS 7
+#define ACTUATOR_DOWN_ENABLED_ADDRESS 8
+#define ENCODER_ADDRESS A2
+#define ENCODER_CHANNEL 2 // ENCODER_ADDRESS - A0, the ADC mux channel
+#define STATUS_LED_ADDRESS 13
+
+#if defined(__AVR_ATmega2560__)
+  #define PINS_DIRECT_IO
+
+  #define BLENDER_PORT PORTH
+  #define BLENDER_IN PINH
+  #define BLENDER_BIT PH6
+  #define PUMP_PORT PORTB
+  #define PUMP_IN PINB
+  #define PUMP_BIT PB2
+  #define LIQUID_FILLING_VALVE_PORT PORTL
+  #define LIQUID_FILLING_VALVE_IN PINL
+  #define LIQUID_FILLING_VALVE_BIT PL0
+  #define CLEANING_VALVE_PORT PORTB
+  #define CLEANING_VALVE_IN PINB
+  #define CLEANING_VALVE_BIT PB0
+  #define BLENDER_SPEED_PORT PORTC
+  #define BLENDER_SPEED_IN PINC
+  #define BLENDER_SPEED_BIT PC2
+  #define ACTUATOR_UP_ENABLED_PORT PORTH
+  #define ACTUATOR_UP_ENABLED_IN PINH
+  #define ACTUATOR_UP_ENABLED_BIT PH4
+  #define ACTUATOR_DOWN_ENABLED_PORT PORTH
+  #define ACTUATOR_DOWN_ENABLED_IN PINH
+  #define ACTUATOR_DOWN_ENABLED_BIT PH5
+  #define STATUS_LED_PORT PORTB
+  #define STATUS_LED_IN PINB
+  #define STATUS_LED_BIT PB7
+
+  // pin 3 is OC3C, pin 4 is OC0B
+  #define ACTUATOR_UP_PORT PORTE
+  #define ACTUATOR_UP_BIT PE5
+  #define ACTUATOR_UP_OCR OCR3C
+  #define ACTUATOR_UP_TCCR TCCR3A
+  #define ACTUATOR_UP_COM COM3C1
+  #define ACTUATOR_DOWN_PORT PORTG
+  #define ACTUATOR_DOWN_BIT PG5
+  #define ACTUATOR_DOWN_OCR OCR0B
+  #define ACTUATOR_DOWN_TCCR TCCR0A
+  #define ACTUATOR_DOWN_COM COM0B1
+#endif
+
+#ifdef PINS_DIRECT_IO
+  #define PIN_SET(name) (name##_PORT |= _BV(name##_BIT))
+  #define PIN_CLEAR(name) (name##_PORT &= ~_BV(name##_BIT))
+  #define PIN_READ(name) ((name##_IN & _BV(name##_BIT)) ? HIGH : LOW)
+  // 0 and 255 turn the PWM off and hold the pin, like analogWrite
+  #define PWM_WRITE(name, duty) do { \
+      if ((unsigned char)(duty) == 0 || (unsigned char)(duty) == 0xFF) { \
+        name##_TCCR &= ~_BV(name##_COM); \
+        if ((unsigned char)(duty) == 0) { PIN_CLEAR(name); } else { PIN_SET(name); } \
+      } else { \
+        name##_OCR = (duty); \
+        name##_TCCR |= _BV(name##_COM); \
+      } \
+    } while (0)
+#else
+  #define PIN_SET(name) digitalWrite(name##_ADDRESS, HIGH)
+  #define PIN_CLEAR(name) digitalWrite(name##_ADDRESS, LOW)
+  #define PIN_READ(name) digitalRead(name##_ADDRESS)
+  #define PWM_WRITE(name, duty) analogWrite(name##_ADDRESS, (duty))
+#endif
+
+#define PIN_WRITE(name, value) do { if (value) { PIN_SET(name); } else { PIN_CLEAR(name); } } while (0)
+
+#endif
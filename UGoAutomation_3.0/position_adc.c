@@ -0,0 +1,142 @@
+/***************************************************
+  Position ADC                      <position_adc.c>
+
+  Oversampling front end for the actuator position
+  pot. The ADC free runs on the position channel and
+  the conversion interrupt adds up 16 readings, then
+  shifts the sum right by 2. The noise on the pot
+  dithers the readings enough to give 12 bit
+  positions from the 10 bit converter, at ~601 Hz.
+
+  The ADC belongs to this module once it has been
+  started, analogRead must not be used on any pin
+  while it is running.
+***************************************************/
+#include "position_adc.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+static volatile unsigned int position_adc_sum;
+static volatile unsigned char position_adc_samples;
+static volatile int position_adc_value;
+static volatile unsigned char position_adc_outputs;
+static char position_adc_channel;
+
+ISR(ADC_vect) {
+  position_adc_sum += ADC;
+
+  if (++position_adc_samples >= POSITION_ADC_OVERSAMPLE) {
+    position_adc_value = position_adc_sum >> POSITION_ADC_DECIMATE_SHIFT;
+    position_adc_sum = 0;
+    position_adc_samples = 0;
+    position_adc_outputs++;
+  }
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  position_adc_init                <position_adc.c>
+
+  SYNTAX: void position_adc_init( char channel );
+
+  DESCRIPTION:
+  Starts the ADC free running on a channel against
+  AVcc with the conversion interrupt enabled, and
+  turns off the digital input buffer on the pin.
+
+  PARAMETER1: The ADC channel, 2 for pin A2
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void position_adc_init(char channel) {
+  position_adc_channel = channel;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    position_adc_sum = 0;
+    position_adc_samples = 0;
+    position_adc_value = 0;
+    position_adc_outputs = 0;
+  }
+
+  ADMUX = _BV(REFS0) | (channel & 0x07);
+  // free running trigger source, high bank for channels 8-15
+  ADCSRB = (channel & 0x08) ? _BV(MUX5) : 0;
+  if (channel < 8) {
+    DIDR0 |= _BV(channel);
+  }
+  ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIF) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  position_adc_read                <position_adc.c>
+
+  SYNTAX: int position_adc_read( void );
+
+  DESCRIPTION:
+  Returns the latest decimated position, 0 to 4092.
+
+  RETURN VALUE:  12 bit position
+  END DESCRIPTION ***********************************/
+int position_adc_read() {
+  int value;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    value = position_adc_value;
+  }
+  return value;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  position_adc_count               <position_adc.c>
+
+  SYNTAX: unsigned char position_adc_count( void );
+
+  DESCRIPTION:
+  Counts decimated outputs, wrapping at 256. Compare
+  with the last count seen to know if a new position
+  is ready.
+
+  RETURN VALUE:  the output count
+  END DESCRIPTION ***********************************/
+unsigned char position_adc_count() {
+  return position_adc_outputs;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  position_adc_suspend             <position_adc.c>
+
+  SYNTAX: void position_adc_suspend( void );
+
+  DESCRIPTION:
+  Stops the conversions and turns the ADC off, the
+  last position is still returned. For low power
+  idle, while the actuator is not driven.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void position_adc_suspend() {
+  ADCSRA &= ~(_BV(ADATE) | _BV(ADIE));
+  ADCSRA &= ~_BV(ADEN);
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  position_adc_resume              <position_adc.c>
+
+  SYNTAX: void position_adc_resume( void );
+
+  DESCRIPTION:
+  Starts the conversions again after a suspend. The
+  first new position is ready ~1.7 ms later, the
+  output count carries on from where it was.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void position_adc_resume() {
+  unsigned char outputs = position_adc_outputs;
+  int value = position_adc_read();
+
+  position_adc_init(position_adc_channel);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    position_adc_outputs = outputs;
+    position_adc_value = value;
+  }
+}
@@ -0,0 +1,17 @@
+#ifndef POSITION_ADC_H
+#define POSITION_ADC_H
+
+#include "global.h"
+
+// 16 MHz / 128 prescaler / 13 cycles = ~9615 conversions per second,
+// 16 conversions per output gives 12 bit positions at ~601 Hz
+#define POSITION_ADC_OVERSAMPLE 16
+#define POSITION_ADC_DECIMATE_SHIFT 2
+
+void position_adc_init(char);
+int position_adc_read();
+unsigned char position_adc_count();
+void position_adc_suspend();
+void position_adc_resume();
+
+#endif
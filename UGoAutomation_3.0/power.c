@@ -0,0 +1,191 @@
+/***************************************************
+  Power                                    <power.c>
+
+  Low power idle for stations waiting between
+  orders. After POWER_IDLE_DELAY at rest the task
+  rates drop, the position ADC is turned off and
+  the CPU sleeps in idle mode whenever loop() has
+  nothing to do.
+
+  Idle sleep keeps the timers and the UART running,
+  so millis(), the sonar and USB receive all carry
+  on, and any interrupt wakes the CPU. The Timer0
+  tick wakes it at least every 1.024 ms to run the
+  scheduler. The keypad pins have no pin change
+  interrupts on the Mega, so the keypad task stays
+  at its full rate and a press wakes the station
+  from there, as does any byte from the HMI.
+
+  The wake latency reported is the time from the
+  press or message being seen to the motion task
+  running at its full rate again.
+***************************************************/
+#define LOG_FILE_ID 7
+#include "power.h"
+#include "position_adc.h"
+#include "soft_timer.h"
+#include <avr/sleep.h>
+#include <avr/interrupt.h>
+
+static char power_current_mode;
+static POWER_RATE_PTR power_set_rates;
+static unsigned long power_active_time; // ms
+static unsigned long power_low_start; // ms
+static unsigned long power_low_total; // ms
+static unsigned long power_wake_start; // us
+static char power_wake_pending;
+static unsigned long power_wakes;
+static unsigned long power_last_latency; // us
+static unsigned long power_max_latency; // us
+
+/* START FUNCTION DESCRIPTION *********************
+  power_init                               <power.c>
+
+  SYNTAX: void power_init( POWER_RATE_PTR set_rates );
+
+  DESCRIPTION:
+  Starts in the active mode.
+
+  PARAMETER1: Sets the task rates for a mode
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void power_init(POWER_RATE_PTR set_rates) {
+  power_set_rates = set_rates;
+  power_current_mode = POWER_ACTIVE;
+  power_active_time = soft_timer_now();
+  power_low_total = 0;
+  power_wake_pending = 0;
+  power_wakes = 0;
+  power_last_latency = 0;
+  power_max_latency = 0;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  power_update                             <power.c>
+
+  SYNTAX: void power_update( char at_rest );
+
+  DESCRIPTION:
+  Call from the motion task. Goes low power once the
+  station has been at rest long enough, and wakes it
+  if it is not at rest any more.
+
+  PARAMETER1: 1 if idle, not moving and no button
+              held
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void power_update(char at_rest) {
+  unsigned long latency;
+
+  if (power_wake_pending) {
+    power_wake_pending = 0;
+    latency = micros() - power_wake_start;
+    power_last_latency = latency;
+    if (latency > power_max_latency) {
+      power_max_latency = latency;
+    }
+  }
+
+  if (!at_rest) {
+    power_wake();
+    return;
+  }
+
+  if (power_current_mode == POWER_ACTIVE && soft_timer_now() - power_active_time >= POWER_IDLE_DELAY) {
+    LOG_PRINT(LOGGER_INFO, "Entering low power idle");
+    power_current_mode = POWER_LOW;
+    power_low_start = soft_timer_now();
+    position_adc_suspend();
+    power_set_rates(POWER_LOW);
+  }
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  power_wake                               <power.c>
+
+  SYNTAX: void power_wake( void );
+
+  DESCRIPTION:
+  Marks activity, going back to full rate if the
+  station is in low power idle.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void power_wake() {
+  power_active_time = soft_timer_now();
+  if (power_current_mode != POWER_LOW) {
+    return;
+  }
+
+  power_wake_start = micros();
+  power_wake_pending = 1;
+  power_wakes++;
+  power_low_total += soft_timer_now() - power_low_start;
+  power_current_mode = POWER_ACTIVE;
+  position_adc_resume();
+  power_set_rates(POWER_ACTIVE);
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  power_sleep                              <power.c>
+
+  SYNTAX: void power_sleep( void );
+
+  DESCRIPTION:
+  Sleeps the CPU until the next interrupt when in
+  low power idle, returns straight away otherwise.
+  Call from loop() after the scheduler.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void power_sleep() {
+  if (power_current_mode != POWER_LOW) {
+    return;
+  }
+
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  cli();
+  sleep_enable();
+  // the instruction after sei always runs, so no interrupt can slip in
+  // between and leave the CPU asleep with work to do
+  sei();
+  sleep_cpu();
+  sleep_disable();
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  power_mode                               <power.c>
+
+  SYNTAX: char power_mode( void );
+
+  RETURN VALUE:  POWER_ACTIVE or POWER_LOW
+  END DESCRIPTION ***********************************/
+char power_mode() {
+  return power_current_mode;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  power_report                             <power.c>
+
+  SYNTAX: void power_report( void );
+
+  DESCRIPTION:
+  Sends the mode, time spent in low power, number
+  of wakes and the wake latency as a status message.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void power_report() {
+  char status[80];
+  unsigned long low_total = power_low_total;
+
+  if (power_current_mode == POWER_LOW) {
+    low_total += soft_timer_now() - power_low_start;
+  }
+  sprintf_P(status, PSTR("Power %s low:%lus wakes:%lu latency:%luus max:%luus"),
+    power_current_mode == POWER_LOW ? "low" : "active", low_total / 1000, power_wakes,
+    power_last_latency, power_max_latency);
+  send_status(status);
+}
@@ -0,0 +1,22 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include "global.h"
+
+#define POWER_ACTIVE 0
+#define POWER_LOW 1
+
+// time at rest with nothing pressed or received before going low power
+#define POWER_IDLE_DELAY 30000 // ms
+
+// called with POWER_ACTIVE or POWER_LOW to set the task rates
+typedef void (* POWER_RATE_PTR)(char);
+
+void power_init(POWER_RATE_PTR);
+void power_update(char);
+void power_wake();
+void power_sleep();
+char power_mode();
+void power_report();
+
+#endif
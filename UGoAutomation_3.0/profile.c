@@ -0,0 +1,165 @@
+/***************************************************
+  Profile                                <profile.c>
+
+  Execution time statistics. Each slot keeps the
+  count, min, max and mean time of a piece of code,
+  plus a coarse power of two histogram, all in
+  microseconds from micros() (4 us resolution).
+
+  Slots cover the loop period, log_print and every
+  scheduler task. The stats are sent on request as
+  MSG_PROFILE_REPORT messages and can be reset with
+  MSG_PROFILE_RESET.
+
+  Usage example:
+  unsigned long start = micros();
+  ...
+  profile_end(PROFILE_LOG, start);
+***************************************************/
+#include "profile.h"
+
+static profile_slot_t profile_slots[PROFILE_SLOTS];
+
+/* START FUNCTION DESCRIPTION *********************
+  profile_init                           <profile.c>
+
+  SYNTAX: void profile_init( void );
+
+  DESCRIPTION:
+  Names the fixed slots and clears every slot.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void profile_init() {
+  memset(profile_slots, 0, sizeof(profile_slots));
+  profile_name(PROFILE_LOOP, "loop");
+  profile_name(PROFILE_LOG, "log");
+  profile_reset();
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  profile_name                           <profile.c>
+
+  SYNTAX: void profile_name( char slot, char* name );
+
+  DESCRIPTION:
+  Names a slot for the report.
+
+  PARAMETER1: The slot
+  PARAMETER2: The name, only the pointer is kept
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void profile_name(char slot, char* name) {
+  if (slot >= 0 && slot < PROFILE_SLOTS) {
+    profile_slots[(int)slot].name = name;
+  }
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  profile_end                            <profile.c>
+
+  SYNTAX: void profile_end( char slot, unsigned long start );
+
+  DESCRIPTION:
+  Adds the time since start to a slot.
+
+  PARAMETER1: The slot
+  PARAMETER2: micros() when the timed code started
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void profile_end(char slot, unsigned long start) {
+  unsigned long elapsed = micros() - start;
+  unsigned long bucket_time = elapsed >> 4;
+  profile_slot_t* entry;
+  char bucket = 0;
+
+  if (slot < 0 || slot >= PROFILE_SLOTS) {
+    return;
+  }
+  entry = &profile_slots[(int)slot];
+
+  // halve both rather than overflow, the mean stays right
+  if (entry->total + elapsed < entry->total) {
+    entry->total >>= 1;
+    entry->count >>= 1;
+  }
+  entry->total += elapsed;
+  entry->count++;
+
+  if (elapsed < entry->min) {
+    entry->min = elapsed;
+  }
+  if (elapsed > entry->max) {
+    entry->max = elapsed;
+  }
+
+  while (bucket_time && bucket < PROFILE_BUCKETS - 1) {
+    bucket_time >>= 1;
+    bucket++;
+  }
+  if (entry->histogram[(int)bucket] < 0xFFFF) {
+    entry->histogram[(int)bucket]++;
+  }
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  profile_report                         <profile.c>
+
+  SYNTAX: void profile_report( void );
+
+  DESCRIPTION:
+  Sends one MSG_PROFILE_REPORT for every slot that
+  has been used since the last reset.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void profile_report() {
+  hmi_message_t msg;
+  profile_report_t* report = (profile_report_t*)msg.payload;
+  profile_slot_t* entry;
+  char i;
+
+  msg.message_id = MSG_PROFILE_REPORT;
+  for (i = 0; i < PROFILE_SLOTS; i++) {
+    entry = &profile_slots[(int)i];
+    if (!entry->count) {
+      continue;
+    }
+
+    memset(report, 0, sizeof(profile_report_t));
+    report->slot = i;
+    if (entry->name) {
+      strncpy(report->name, entry->name, PROFILE_NAME_SIZE);
+    }
+    report->count = entry->count;
+    report->min = entry->min;
+    report->max = entry->max;
+    report->mean = entry->total / entry->count;
+    memcpy(report->histogram, entry->histogram, sizeof(report->histogram));
+    c_send_message(msg, sizeof(profile_report_t));
+  }
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  profile_reset                          <profile.c>
+
+  SYNTAX: void profile_reset( void );
+
+  DESCRIPTION:
+  Clears the stats of every slot, names are kept.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void profile_reset() {
+  char i;
+
+  for (i = 0; i < PROFILE_SLOTS; i++) {
+    profile_slots[(int)i].count = 0;
+    profile_slots[(int)i].total = 0;
+    profile_slots[(int)i].min = 0xFFFFFFFF;
+    profile_slots[(int)i].max = 0;
+    memset(profile_slots[(int)i].histogram, 0, sizeof(profile_slots[(int)i].histogram));
+  }
+}
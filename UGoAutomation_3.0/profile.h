@@ -0,0 +1,43 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "global.h"
+#include "scheduler.h"
+
+#define PROFILE_LOOP 0
+#define PROFILE_LOG 1
+// scheduler task n is profiled in slot PROFILE_TASKS + n
+#define PROFILE_TASKS 2
+#define PROFILE_SLOTS (PROFILE_TASKS + SCHEDULER_MAX_TASKS)
+
+// bucket n counts times below 16 << n us, the last bucket counts the rest
+#define PROFILE_BUCKETS 10
+
+#define PROFILE_NAME_SIZE 10
+
+typedef struct {
+  char* name;
+  unsigned long count;
+  unsigned long total; // us
+  unsigned long min; // us
+  unsigned long max; // us
+  unsigned int histogram[PROFILE_BUCKETS];
+} profile_slot_t;
+
+typedef struct __attribute__((__packed__, aligned(1))) {
+  unsigned char slot;
+  char name[PROFILE_NAME_SIZE];
+  unsigned long count;
+  unsigned long min;
+  unsigned long max;
+  unsigned long mean;
+  unsigned int histogram[PROFILE_BUCKETS];
+} profile_report_t;
+
+void profile_init();
+void profile_name(char, char*);
+void profile_end(char, unsigned long);
+void profile_report();
+void profile_reset();
+
+#endif
@@ -0,0 +1,121 @@
+/***************************************************
+  RAM monitor                        <ram_monitor.c>
+
+  Watches how close the stack gets to the heap. The
+  free RAM between the end of .bss and the top of
+  the stack is painted with RAM_MONITOR_CANARY in
+  .init1, before any C start up code runs. The stack
+  overwrites the paint as it grows and the heap as
+  malloc hands memory out, so the run of untouched
+  paint just above the heap is the least free RAM
+  there has ever been.
+
+  ram_monitor_check() is run from a slow task and
+  logs when the headroom drops below the warning
+  and critical levels.
+***************************************************/
+#define LOG_FILE_ID 8
+#include "ram_monitor.h"
+#include <avr/io.h>
+
+extern unsigned char __stack;
+extern unsigned char __heap_start;
+extern char* __brkval;
+
+static char ram_monitor_level;
+
+#define RAM_MONITOR_STR(x) #x
+#define RAM_MONITOR_XSTR(x) RAM_MONITOR_STR(x)
+
+void ram_monitor_paint(void) __attribute__((naked, used, section(".init1")));
+
+// runs before r1 is cleared and the stack pointer is set up in .init2, so
+// it is all in asm and only uses registers: Z walks from _end through
+// __stack storing the canary
+void ram_monitor_paint(void) {
+  __asm volatile (
+    "    ldi r30, lo8(_end)\n"
+    "    ldi r31, hi8(_end)\n"
+    "    ldi r24, " RAM_MONITOR_XSTR(RAM_MONITOR_CANARY) "\n"
+    "    ldi r25, hi8(__stack + 1)\n"
+    "    rjmp 2f\n"
+    "1:  st Z+, r24\n"
+    "2:  cpi r30, lo8(__stack + 1)\n"
+    "    cpc r31, r25\n"
+    "    brlo 1b\n"
+  );
+}
+
+static unsigned char* ram_monitor_heap_top() {
+  return __brkval ? (unsigned char*)__brkval : &__heap_start;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  ram_monitor_headroom             <ram_monitor.c>
+
+  SYNTAX: unsigned int ram_monitor_headroom( void );
+
+  DESCRIPTION:
+  Counts the paint left above the heap. Takes about
+  a microsecond per 3 bytes counted, so call it from
+  a slow task.
+
+  RETURN VALUE:  bytes the stack has never reached
+  END DESCRIPTION ***********************************/
+unsigned int ram_monitor_headroom() {
+  unsigned char* p = ram_monitor_heap_top();
+  unsigned char* stack = (unsigned char*)(uintptr_t)SP;
+
+  while (p < stack && *p == RAM_MONITOR_CANARY) {
+    p++;
+  }
+  return p - ram_monitor_heap_top();
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  ram_monitor_check                <ram_monitor.c>
+
+  SYNTAX: void ram_monitor_check( void );
+
+  DESCRIPTION:
+  Logs once when the stack headroom first drops
+  below RAM_MONITOR_WARNING and again below
+  RAM_MONITOR_CRITICAL.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void ram_monitor_check() {
+  unsigned int headroom = ram_monitor_headroom();
+
+  if (headroom < RAM_MONITOR_CRITICAL && ram_monitor_level < 2) {
+    ram_monitor_level = 2;
+    LOG_PRINT(LOGGER_ERROR, "Stack headroom critical: %u bytes", headroom);
+  } else if (headroom < RAM_MONITOR_WARNING && ram_monitor_level < 1) {
+    ram_monitor_level = 1;
+    LOG_PRINT(LOGGER_WARNING, "Stack headroom low: %u bytes", headroom);
+  }
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  ram_monitor_report               <ram_monitor.c>
+
+  SYNTAX: void ram_monitor_report( void );
+
+  DESCRIPTION:
+  Sends a MSG_MEMORY_REPORT with the RAM use.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void ram_monitor_report() {
+  hmi_message_t msg;
+  ram_monitor_report_t* report = (ram_monitor_report_t*)msg.payload;
+  unsigned char* heap_top = ram_monitor_heap_top();
+
+  msg.message_id = MSG_MEMORY_REPORT;
+  report->static_size = &__heap_start - (unsigned char*)RAMSTART;
+  report->heap_size = heap_top - &__heap_start;
+  report->free_now = (unsigned char*)(uintptr_t)SP - heap_top;
+  report->stack_headroom = ram_monitor_headroom();
+  report->stack_max = &__stack - (heap_top + report->stack_headroom) + 1;
+  c_send_message(msg, sizeof(ram_monitor_report_t));
+}
@@ -0,0 +1,31 @@
+#ifndef RAM_MONITOR_H
+#define RAM_MONITOR_H
+
+#include "global.h"
+
+// painted over the free RAM at boot, the stack overwrites it as it grows
+#define RAM_MONITOR_CANARY 0xC5
+
+// stack headroom (bytes never touched between the heap and the stack)
+// below which a warning and then an error is logged
+#define RAM_MONITOR_WARNING 512
+#define RAM_MONITOR_CRITICAL 256
+
+typedef struct __attribute__((__packed__, aligned(1))) {
+  /* .data and .bss */
+  unsigned int static_size;
+  /* top of the heap above the end of .bss */
+  unsigned int heap_size;
+  /* between the heap and the stack pointer now */
+  unsigned int free_now;
+  /* never touched since boot, the stack high water mark */
+  unsigned int stack_headroom;
+  /* deepest the stack has been */
+  unsigned int stack_max;
+} ram_monitor_report_t;
+
+void ram_monitor_check();
+unsigned int ram_monitor_headroom();
+void ram_monitor_report();
+
+#endif
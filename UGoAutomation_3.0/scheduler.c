@@ -0,0 +1,166 @@
+/***************************************************
+  Scheduler                            <scheduler.c>
+
+  Cooperative fixed rate scheduler for the main loop.
+  Tasks are added with a period in microseconds and
+  are run from loop() in the order they were added,
+  each at most once per pass, so the order within a
+  pass is always the same.
+
+  Due times advance by the period rather than from
+  when the task ran, so rates do not drift. A task
+  that falls a whole period behind counts a deadline
+  miss and picks up from now, it never runs in a
+  burst to catch up. A task that runs longer than
+  its own period counts an overrun.
+
+  Times are compared by subtraction so they keep
+  working when micros() wraps every ~70 minutes.
+
+  Usage example:
+  scheduler_add(motion_task, "motion", 2000);
+***************************************************/
+#define LOG_FILE_ID 9
+#include "scheduler.h"
+#include "profile.h"
+#include "soft_timer.h"
+
+static scheduler_task_t scheduler_tasks[SCHEDULER_MAX_TASKS];
+static char scheduler_task_count;
+static unsigned long scheduler_last_pass;
+
+/* START FUNCTION DESCRIPTION *********************
+  scheduler_init                       <scheduler.c>
+
+  SYNTAX: void scheduler_init( void );
+
+  DESCRIPTION:
+  Removes every task.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void scheduler_init() {
+  memset(scheduler_tasks, 0, sizeof(scheduler_tasks));
+  scheduler_task_count = 0;
+  scheduler_last_pass = micros();
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  scheduler_add                        <scheduler.c>
+
+  SYNTAX: char scheduler_add( TASK_PTR task, char* name, unsigned long period );
+
+  DESCRIPTION:
+  Adds a task after the ones already added. It is
+  first due straight away.
+
+  PARAMETER1: The function to run
+  PARAMETER2: A short name for reports
+  PARAMETER3: The period in microseconds
+
+  RETURN VALUE:  the task id, -1 if the table is full
+  END DESCRIPTION ***********************************/
+char scheduler_add(TASK_PTR task, char* name, unsigned long period) {
+  scheduler_task_t* entry;
+
+  if (scheduler_task_count >= SCHEDULER_MAX_TASKS) {
+    LOG_PRINT(LOGGER_ERROR, "Scheduler full, %s not added", name);
+    return -1;
+  }
+
+  entry = &scheduler_tasks[(int)scheduler_task_count];
+  entry->task = task;
+  entry->name = name;
+  entry->period = period;
+  entry->next_run = micros();
+  entry->overruns = 0;
+  entry->deadline_misses = 0;
+  profile_name(PROFILE_TASKS + scheduler_task_count, name);
+  return scheduler_task_count++;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  scheduler_run                        <scheduler.c>
+
+  SYNTAX: void scheduler_run( void );
+
+  DESCRIPTION:
+  Runs every task that is due, in order. Call from
+  loop() and nothing else.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void scheduler_run() {
+  scheduler_task_t* entry;
+  unsigned long start;
+  char i;
+
+  // the loop period is the time from one pass to the next
+  profile_end(PROFILE_LOOP, scheduler_last_pass);
+  scheduler_last_pass = micros();
+  soft_timer_tick();
+
+  for (i = 0; i < scheduler_task_count; i++) {
+    entry = &scheduler_tasks[(int)i];
+    start = micros();
+    if ((long)(start - entry->next_run) < 0) {
+      continue;
+    }
+
+    entry->task();
+
+    entry->next_run += entry->period;
+    if ((long)(start - entry->next_run) >= 0) {
+      entry->deadline_misses++;
+      entry->next_run = start + entry->period;
+    }
+    if (micros() - start > entry->period) {
+      entry->overruns++;
+    }
+    profile_end(PROFILE_TASKS + i, start);
+  }
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  scheduler_set_period                 <scheduler.c>
+
+  SYNTAX: void scheduler_set_period( char id, unsigned long period );
+
+  DESCRIPTION:
+  Changes how often a task runs. The task is due
+  straight away and then every new period.
+
+  PARAMETER1: The task id from scheduler_add
+  PARAMETER2: The period in microseconds
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void scheduler_set_period(char id, unsigned long period) {
+  if (id < 0 || id >= scheduler_task_count) {
+    return;
+  }
+  scheduler_tasks[(int)id].period = period;
+  scheduler_tasks[(int)id].next_run = micros();
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  scheduler_report                     <scheduler.c>
+
+  SYNTAX: void scheduler_report( void );
+
+  DESCRIPTION:
+  Sends the period, overrun and deadline miss counts
+  of every task as status messages.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void scheduler_report() {
+  char status[64];
+  char i;
+
+  for (i = 0; i < scheduler_task_count; i++) {
+    sprintf_P(status, PSTR("Task %s period:%lu overruns:%u misses:%u"), scheduler_tasks[(int)i].name,
+      scheduler_tasks[(int)i].period, scheduler_tasks[(int)i].overruns, scheduler_tasks[(int)i].deadline_misses);
+    send_status(status);
+  }
+}
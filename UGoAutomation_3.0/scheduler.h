@@ -0,0 +1,27 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "global.h"
+
+#define SCHEDULER_MAX_TASKS 8
+
+typedef void (* TASK_PTR)(void);
+
+typedef struct {
+  TASK_PTR task;
+  char* name;
+  unsigned long period; // us
+  unsigned long next_run; // us
+  /* times the task took longer than its period */
+  unsigned int overruns;
+  /* times it started a whole period late, the missed runs are skipped */
+  unsigned int deadline_misses;
+} scheduler_task_t;
+
+void scheduler_init();
+char scheduler_add(TASK_PTR, char*, unsigned long);
+void scheduler_run();
+void scheduler_set_period(char, unsigned long);
+void scheduler_report();
+
+#endif
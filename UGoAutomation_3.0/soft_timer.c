@@ -0,0 +1,180 @@
+/***************************************************
+  Soft timer                          <soft_timer.c>
+
+  Millisecond timers and the time snapshot every
+  task of a scheduler pass works from.
+
+  soft_timer_tick() reads millis() once at the start
+  of every pass, soft_timer_now() returns that, so
+  the tasks of a pass agree on the time and do not
+  each read the clock again.
+
+  Running timers hang off a small timer wheel, one
+  slot per SOFT_TIMER_WHEEL_TICK ms. A tick only
+  looks at the slots that have come due since the
+  last one, so the cost does not grow with the
+  number of timers waiting. Timers further out than
+  one turn of the wheel stay in their slot for the
+  later turns.
+
+  Deadlines are compared by subtraction so timers
+  keep working when millis() wraps after 49 days.
+
+  Usage example:
+  soft_timer_start(&step_timer, 3000, NULL);
+  if (soft_timer_expired(&step_timer)) { ... }
+***************************************************/
+#include "soft_timer.h"
+
+#define SOFT_TIMER_SLOT(time) (((time) / SOFT_TIMER_WHEEL_TICK) & (SOFT_TIMER_WHEEL_SLOTS - 1))
+
+unsigned long soft_timer_time;
+
+static soft_timer_t* soft_timer_wheel[SOFT_TIMER_WHEEL_SLOTS];
+// the last ms of the next slot to check, a slot is only checked once
+// all of its deadlines are due
+static unsigned long soft_timer_wheel_time;
+
+/* START FUNCTION DESCRIPTION *********************
+  soft_timer_init                     <soft_timer.c>
+
+  SYNTAX: void soft_timer_init( void );
+
+  DESCRIPTION:
+  Takes the first time snapshot and empties the
+  wheel. Call from setup() before anything that
+  uses soft_timer_now().
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void soft_timer_init() {
+  memset(soft_timer_wheel, 0, sizeof(soft_timer_wheel));
+  soft_timer_time = millis();
+  soft_timer_wheel_time = (soft_timer_time | (SOFT_TIMER_WHEEL_TICK - 1));
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  soft_timer_tick                     <soft_timer.c>
+
+  SYNTAX: void soft_timer_tick( void );
+
+  DESCRIPTION:
+  Takes the time snapshot for this pass and fires
+  the timers that are due. Called by the scheduler
+  at the start of every pass.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void soft_timer_tick() {
+  soft_timer_t** link;
+  soft_timer_t* timer;
+  unsigned long behind;
+
+  soft_timer_time = millis();
+
+  // after a long stall every slot is checked once rather than lap by lap
+  behind = soft_timer_time - soft_timer_wheel_time;
+  if ((long)behind >= (long)(SOFT_TIMER_WHEEL_SLOTS * SOFT_TIMER_WHEEL_TICK)) {
+    soft_timer_wheel_time += (behind / SOFT_TIMER_WHEEL_TICK - (SOFT_TIMER_WHEEL_SLOTS - 1)) * SOFT_TIMER_WHEEL_TICK;
+  }
+
+  while ((long)(soft_timer_time - soft_timer_wheel_time) >= 0) {
+    link = &soft_timer_wheel[SOFT_TIMER_SLOT(soft_timer_wheel_time)];
+    while (*link) {
+      timer = *link;
+      if ((long)(soft_timer_time - timer->deadline) < 0) {
+        // due on a later turn of the wheel
+        link = &timer->next;
+        continue;
+      }
+
+      *link = timer->next;
+      timer->next = NULL;
+      timer->state = SOFT_TIMER_EXPIRED;
+      if (timer->callback) {
+        timer->callback(timer);
+      }
+    }
+    soft_timer_wheel_time += SOFT_TIMER_WHEEL_TICK;
+  }
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  soft_timer_start                    <soft_timer.c>
+
+  SYNTAX: void soft_timer_start( soft_timer_t* timer, unsigned long duration, SOFT_TIMER_CALLBACK callback );
+
+  DESCRIPTION:
+  Starts a timer from the time of this pass, a timer
+  that is already running is restarted.
+
+  PARAMETER1: The timer
+  PARAMETER2: How long until it expires (ms)
+  PARAMETER3: Called from soft_timer_tick() when it
+              expires, NULL to only poll it
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void soft_timer_start(soft_timer_t* timer, unsigned long duration, SOFT_TIMER_CALLBACK callback) {
+  soft_timer_t** slot;
+
+  soft_timer_stop(timer);
+  timer->callback = callback;
+  timer->deadline = soft_timer_time + duration;
+  timer->state = SOFT_TIMER_RUNNING;
+
+  // a deadline in a slot that has already been checked this turn would
+  // wait a whole turn, those are due by the next tick anyway
+  if ((long)(timer->deadline - soft_timer_wheel_time) <= 0) {
+    timer->deadline = soft_timer_wheel_time;
+  }
+  slot = &soft_timer_wheel[SOFT_TIMER_SLOT(timer->deadline)];
+  timer->next = *slot;
+  *slot = timer;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  soft_timer_stop                     <soft_timer.c>
+
+  SYNTAX: void soft_timer_stop( soft_timer_t* timer );
+
+  DESCRIPTION:
+  Stops a timer and clears an expiry, safe to call
+  on a timer that is not running.
+
+  PARAMETER1: The timer
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void soft_timer_stop(soft_timer_t* timer) {
+  soft_timer_t** link;
+
+  if (timer->state == SOFT_TIMER_RUNNING) {
+    link = &soft_timer_wheel[SOFT_TIMER_SLOT(timer->deadline)];
+    while (*link && *link != timer) {
+      link = &(*link)->next;
+    }
+    if (*link) {
+      *link = timer->next;
+    }
+  }
+  timer->next = NULL;
+  timer->state = SOFT_TIMER_IDLE;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  soft_timer_expired                  <soft_timer.c>
+
+  SYNTAX: char soft_timer_expired( soft_timer_t* timer );
+
+  DESCRIPTION:
+  Whether a timer has run out. It stays expired
+  until it is started or stopped again.
+
+  PARAMETER1: The timer
+
+  RETURN VALUE:  1 if expired, 0 if not
+  END DESCRIPTION ***********************************/
+char soft_timer_expired(soft_timer_t* timer) {
+  return timer->state == SOFT_TIMER_EXPIRED;
+}
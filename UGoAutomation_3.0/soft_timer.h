@@ -0,0 +1,34 @@
+#ifndef SOFT_TIMER_H
+#define SOFT_TIMER_H
+
+#include "global.h"
+
+// the wheel turns once every SLOTS x TICK ms, a timer fires at most TICK - 1 ms late
+#define SOFT_TIMER_WHEEL_SLOTS 16 // power of 2
+#define SOFT_TIMER_WHEEL_TICK 4 // ms, power of 2
+
+#define SOFT_TIMER_IDLE 0
+#define SOFT_TIMER_RUNNING 1
+#define SOFT_TIMER_EXPIRED 2
+
+typedef struct soft_timer soft_timer_t;
+typedef void (* SOFT_TIMER_CALLBACK)(soft_timer_t*);
+
+struct soft_timer {
+  unsigned long deadline;
+  SOFT_TIMER_CALLBACK callback;
+  soft_timer_t* next;
+  char state;
+};
+
+// millis() as of the start of this scheduler pass
+extern unsigned long soft_timer_time;
+#define soft_timer_now() (soft_timer_time)
+
+void soft_timer_init();
+void soft_timer_tick();
+void soft_timer_start(soft_timer_t*, unsigned long, SOFT_TIMER_CALLBACK);
+void soft_timer_stop(soft_timer_t*);
+char soft_timer_expired(soft_timer_t*);
+
+#endif
@@ -0,0 +1,264 @@
+/***************************************************
+  Speed Model                        <speed_model.c>
+
+  Keeps a table of the velocity the actuator really
+  reaches at each PWM level, in both directions.
+
+  The table is filled by a self-test that strokes the
+  actuator between TOP_POSITION and BOTTOM_OF_CUP at
+  every level and times it across a window in the
+  middle of the stroke. The result is kept in EEPROM
+  so it survives a reboot.
+
+  Move to position actions can then ask for a travel
+  time, and the model picks the PWM that covers the
+  distance in that time without going above the speed
+  the recipe allows.
+***************************************************/
+#define LOG_FILE_ID 10
+#include "speed_model.h"
+#include <avr/eeprom.h>
+
+speed_model_t speed_model;
+
+static void speed_model_report() {
+  char status[48];
+  int i;
+
+  for (i = 0; i < SPEED_MODEL_LEVELS; i++) {
+    sprintf_P(status, PSTR("Speed model pwm:%d down:%d up:%d"), speed_model.pwm[i],
+      speed_model.velocity[BLENDER_MOVEMENT_DOWN][i], speed_model.velocity[BLENDER_MOVEMENT_UP][i]);
+    send_status(status);
+  }
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  speed_model_init                    <speed_model.c>
+
+  SYNTAX: void speed_model_init( void );
+
+  DESCRIPTION:
+  Loads the last calibration from EEPROM. If nothing
+  valid is stored the model stays uncalibrated and
+  move to position uses the recipe speeds unchanged.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void speed_model_init() {
+  eeprom_read_block(&speed_model, (const void*)EEPROM_SPEED_MODEL_ADDRESS, sizeof(speed_model));
+
+  if (speed_model.version != SPEED_MODEL_VERSION) {
+    memset(&speed_model, 0, sizeof(speed_model));
+    speed_model.version = SPEED_MODEL_VERSION;
+  }
+
+  speed_model.pwm[0] = MOTOR_SPEED_QUARTER;
+  speed_model.pwm[1] = MOTOR_SPEED_THIRD;
+  speed_model.pwm[2] = MOTOR_SPEED_HALF;
+  speed_model.pwm[3] = MOTOR_SPEED_FULL;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  speed_model_calibration_start       <speed_model.c>
+
+  SYNTAX: void speed_model_calibration_start( speed_model_calibration_t* );
+
+  DESCRIPTION:
+  Resets a calibration run, the first call to
+  speed_model_calibrate will home the actuator.
+
+  PARAMETER1: The calibration run to reset
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void speed_model_calibration_start(speed_model_calibration_t* calibration) {
+  calibration->level = 0;
+  calibration->phase = SPEED_MODEL_PHASE_HOME;
+  calibration->in_window = 0;
+  calibration->phase_start_time = soft_timer_now();
+}
+
+// strokes the actuator in one direction and times it across the
+// measuring window, returns true once the stroke has ended
+static char speed_model_stroke(blender_t* blender, speed_model_calibration_t* calibration, char direction) {
+  unsigned char pwm = speed_model.pwm[(int)calibration->level];
+  int* velocity = &speed_model.velocity[(int)direction][(int)calibration->level];
+  int progress, window_enter, window_leave;
+
+  // progress counts up from the start of the stroke in both directions
+  if (direction == BLENDER_MOVEMENT_DOWN) {
+    progress = blender->position - TOP_POSITION;
+    window_enter = SPEED_MODEL_WINDOW_START - TOP_POSITION;
+    window_leave = SPEED_MODEL_WINDOW_END - TOP_POSITION;
+  } else {
+    progress = BOTTOM_OF_CUP - blender->position;
+    window_enter = BOTTOM_OF_CUP - SPEED_MODEL_WINDOW_END;
+    window_leave = BOTTOM_OF_CUP - SPEED_MODEL_WINDOW_START;
+  }
+
+  if (calibration->in_window == 0 && progress >= window_enter) {
+    calibration->in_window = 1;
+    calibration->window_start_time = soft_timer_now();
+  }
+
+  if (calibration->in_window == 1 && progress >= window_leave) {
+    calibration->in_window = 2;
+    *velocity = (long)(window_leave - window_enter) * 1000 / (soft_timer_now() - calibration->window_start_time + 1);
+  }
+
+  if (progress < BOTTOM_OF_CUP - TOP_POSITION && (soft_timer_now() - calibration->phase_start_time) < SPEED_MODEL_STROKE_TIME_OUT) {
+    blender_move(blender, direction, pwm);
+    return false;
+  }
+
+  // a stroke that never left the window could not move at this level
+  if (calibration->in_window != 2) {
+    *velocity = 0;
+  }
+
+  blender_move(blender, BLENDER_MOVEMENT_IDLE, 0);
+  calibration->in_window = 0;
+  calibration->phase_start_time = soft_timer_now();
+  return true;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  speed_model_calibrate               <speed_model.c>
+
+  SYNTAX: char speed_model_calibrate( blender_t*, speed_model_calibration_t* );
+
+  DESCRIPTION:
+  Runs one step of the self-test, call every loop
+  until it returns true. Each level is stroked down
+  to BOTTOM_OF_CUP then back up to TOP_POSITION. A
+  stroke that times out before leaving the window is
+  recorded as 0, the level can not move the actuator.
+
+  PARAMETER1: The blender to calibrate
+  PARAMETER2: The calibration run
+
+  RETURN VALUE:  true when every level was measured
+  END DESCRIPTION ***********************************/
+char speed_model_calibrate(blender_t* blender, speed_model_calibration_t* calibration) {
+  switch (calibration->phase) {
+    case SPEED_MODEL_PHASE_HOME:
+      if (blender->position > TOP_POSITION && (soft_timer_now() - calibration->phase_start_time) < SPEED_MODEL_STROKE_TIME_OUT) {
+        blender_move(blender, BLENDER_MOVEMENT_UP, MOTOR_SPEED_FULL);
+        return false;
+      }
+      blender_move(blender, BLENDER_MOVEMENT_IDLE, 0);
+      calibration->phase = SPEED_MODEL_PHASE_DOWN;
+      calibration->phase_start_time = soft_timer_now();
+      return false;
+
+    case SPEED_MODEL_PHASE_DOWN:
+      if (speed_model_stroke(blender, calibration, BLENDER_MOVEMENT_DOWN)) {
+        calibration->phase = SPEED_MODEL_PHASE_UP;
+      }
+      return false;
+
+    case SPEED_MODEL_PHASE_UP:
+      if (!speed_model_stroke(blender, calibration, BLENDER_MOVEMENT_UP)) {
+        return false;
+      }
+      calibration->phase = SPEED_MODEL_PHASE_DOWN;
+      if (++calibration->level < SPEED_MODEL_LEVELS) {
+        return false;
+      }
+  }
+
+  speed_model.is_calibrated = 1;
+  eeprom_update_block(&speed_model, (void*)EEPROM_SPEED_MODEL_ADDRESS, sizeof(speed_model));
+  LOG_PRINT(LOGGER_INFO, "Speed model calibrated");
+  speed_model_report();
+  return true;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  speed_model_select_speed            <speed_model.c>
+
+  SYNTAX: char speed_model_select_speed( char direction, int distance, int travel_time, char max_speed );
+
+  DESCRIPTION:
+  Picks the PWM that covers a distance in the given
+  travel time, interpolating between the measured
+  levels. Levels above max_speed are never used, if
+  none of the allowed levels is fast enough the
+  fastest allowed one is returned. Never returns less
+  than the slowest level that moved the actuator.
+
+  PARAMETER1: BLENDER_MOVEMENT_DOWN or BLENDER_MOVEMENT_UP
+  PARAMETER2: The distance to travel in position counts
+  PARAMETER3: The desired travel time in ms, 0 for none
+  PARAMETER4: The fastest speed the move may use
+
+  RETURN VALUE:  the PWM to drive the actuator with
+  END DESCRIPTION ***********************************/
+char speed_model_select_speed(char direction, int distance, int travel_time, char max_speed) {
+  long required;
+  int i;
+  unsigned char last_pwm = 0;
+  int last_velocity = 0;
+  int* velocity;
+
+  if (!speed_model.is_calibrated || travel_time <= 0 || direction > BLENDER_MOVEMENT_UP) {
+    return max_speed;
+  }
+
+  velocity = speed_model.velocity[(int)direction];
+  required = (long)abs(distance) * 1000 / travel_time;
+
+  for (i = 0; i < SPEED_MODEL_LEVELS && speed_model.pwm[i] <= (unsigned char)max_speed; i++) {
+    if (velocity[i] >= required) {
+      // nothing slower was seen moving the actuator, going below this
+      // level would risk a stall
+      if (last_velocity == 0 || velocity[i] <= last_velocity) {
+        return speed_model.pwm[i];
+      }
+      return last_pwm + (long)(speed_model.pwm[i] - last_pwm) * (required - last_velocity) / (velocity[i] - last_velocity);
+    }
+    if (velocity[i] > last_velocity) {
+      last_pwm = speed_model.pwm[i];
+      last_velocity = velocity[i];
+    }
+  }
+
+  return max_speed;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  speed_model_velocity                <speed_model.c>
+
+  SYNTAX: int speed_model_velocity( char direction, char speed );
+
+  DESCRIPTION:
+  Looks up the velocity the actuator should reach at
+  a PWM level, interpolating between measured levels.
+
+  PARAMETER1: BLENDER_MOVEMENT_DOWN or BLENDER_MOVEMENT_UP
+  PARAMETER2: The PWM driving the actuator
+
+  RETURN VALUE:  counts per second, 0 if not calibrated
+  END DESCRIPTION ***********************************/
+int speed_model_velocity(char direction, char speed) {
+  unsigned char pwm = speed;
+  unsigned char last_pwm = 0;
+  int last_velocity = 0;
+  int* velocity;
+  int i;
+
+  if (!speed_model.is_calibrated || direction > BLENDER_MOVEMENT_UP) {
+    return 0;
+  }
+
+  velocity = speed_model.velocity[(int)direction];
+  for (i = 0; i < SPEED_MODEL_LEVELS; i++) {
+    if (pwm <= speed_model.pwm[i]) {
+      return last_velocity + (long)(velocity[i] - last_velocity) * (pwm - last_pwm) / (speed_model.pwm[i] - last_pwm);
+    }
+    last_pwm = speed_model.pwm[i];
+    last_velocity = velocity[i];
+  }
+
+  return last_velocity;
+}
@@ -0,0 +1,45 @@
+#ifndef SPEED_MODEL_H
+#define SPEED_MODEL_H
+
+#include "global.h"
+#include "blender.h"
+
+#define SPEED_MODEL_LEVELS 4
+
+// measurements are taken inside this window so the motor has
+// reached a steady speed before timing starts
+#define SPEED_MODEL_WINDOW_START (TOP_POSITION + POSITION(20))
+#define SPEED_MODEL_WINDOW_END (BOTTOM_OF_CUP - POSITION(20))
+#define SPEED_MODEL_STROKE_TIME_OUT 10000
+
+#define SPEED_MODEL_PHASE_HOME 0
+#define SPEED_MODEL_PHASE_DOWN 1
+#define SPEED_MODEL_PHASE_UP 2
+
+// bump when the stored layout or the position units change
+#define SPEED_MODEL_VERSION 2
+
+typedef struct {
+  char version;
+  char is_calibrated;
+  /* PWM duty of each measured level, slowest first */
+  unsigned char pwm[SPEED_MODEL_LEVELS];
+  /* position counts per second, indexed by BLENDER_MOVEMENT_DOWN/UP */
+  int velocity[2][SPEED_MODEL_LEVELS];
+} speed_model_t;
+
+typedef struct {
+  char level;
+  char phase;
+  char in_window;
+  unsigned long phase_start_time;
+  unsigned long window_start_time;
+} speed_model_calibration_t;
+
+void speed_model_init();
+void speed_model_calibration_start(speed_model_calibration_t*);
+char speed_model_calibrate(blender_t*, speed_model_calibration_t*);
+char speed_model_select_speed(char, int, int, char);
+int speed_model_velocity(char, char);
+
+#endif
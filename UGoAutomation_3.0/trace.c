@@ -0,0 +1,174 @@
+/***************************************************
+  Trace                                    <trace.c>
+
+  Motion trace recorder for tuning moves. Once armed
+  for a blend step or a machine state, it records the
+  position, filtered velocity, PWM duty, direction
+  and step into RAM at a fixed rate, from the moment
+  the step or state starts until a few records after
+  it ends. The start of the move is what gets tuned,
+  so a step longer than the buffer stops the capture
+  when it is full rather than overwriting it.
+
+  The capture is dumped over USB afterwards as
+  MSG_TRACE_DUMP messages, oldest record first.
+
+  Usage example, trace blend step 12 at 500 Hz:
+  trace_arm_t arm = { TRACE_ARM_STEP, 12, 2 };
+  trace_arm(&arm);
+***************************************************/
+#define LOG_FILE_ID 11
+#include "trace.h"
+
+#define TRACE_IDLE 0
+#define TRACE_WAITING 1
+#define TRACE_CAPTURING 2
+#define TRACE_COMPLETE 3
+
+typedef struct {
+  char state;
+  trace_arm_t arm;
+  unsigned char head;
+  unsigned char count;
+  unsigned char post_records;
+  unsigned long last_sample_time;
+  trace_record_t records[TRACE_RECORDS];
+} trace_t;
+
+static trace_t trace;
+
+/* START FUNCTION DESCRIPTION *********************
+  trace_arm                                <trace.c>
+
+  SYNTAX: char trace_arm( trace_arm_t* arm );
+
+  DESCRIPTION:
+  Arms a one shot capture, any earlier capture is
+  thrown away. TRACE_ARM_OFF disarms. An unknown
+  mode, or a step or state that does not exist, is
+  refused and leaves the trace as it was.
+
+  PARAMETER1: What to trace and how fast
+
+  RETURN VALUE:  1 if armed or disarmed, 0 if refused
+  END DESCRIPTION ***********************************/
+char trace_arm(trace_arm_t* arm) {
+  if ((arm->mode == TRACE_ARM_STEP && arm->value >= blend_sequence.total_actions) ||
+      (arm->mode == TRACE_ARM_STATE && arm->value >= MACHINE_STATE_COUNT) ||
+      arm->mode < TRACE_ARM_OFF || arm->mode > TRACE_ARM_STATE) {
+    LOG_PRINT(LOGGER_WARNING, "Trace arm refused mode:%d value:%u", arm->mode, arm->value);
+    return 0;
+  }
+
+  trace.arm = *arm;
+  if (trace.arm.period == 0) {
+    trace.arm.period = TRACE_DEFAULT_PERIOD;
+  }
+  trace.head = 0;
+  trace.count = 0;
+  trace.state = (arm->mode == TRACE_ARM_OFF) ? TRACE_IDLE : TRACE_WAITING;
+  LOG_PRINT(LOGGER_INFO, "Trace armed mode:%d value:%u period:%u", trace.arm.mode, trace.arm.value, trace.arm.period);
+  return 1;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  trace_sample                             <trace.c>
+
+  SYNTAX: void trace_sample( blender_t* blender, char state, unsigned char step );
+
+  DESCRIPTION:
+  Call every loop after the position is updated.
+  Starts, records and ends the armed capture.
+
+  PARAMETER1: The blender being traced
+  PARAMETER2: The current machine state
+  PARAMETER3: The current step
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void trace_sample(blender_t* blender, char state, unsigned char step) {
+  char triggered;
+  trace_record_t* record;
+  char status[32];
+
+  if (trace.state != TRACE_WAITING && trace.state != TRACE_CAPTURING) {
+    return;
+  }
+
+  if (trace.arm.mode == TRACE_ARM_STEP) {
+    triggered = (state == MACHINE_STATE_BLENDING && step == trace.arm.value);
+  } else {
+    triggered = ((unsigned char)state == trace.arm.value);
+  }
+
+  if (trace.state == TRACE_WAITING) {
+    if (!triggered) {
+      return;
+    }
+    trace.state = TRACE_CAPTURING;
+    trace.post_records = 0;
+    trace.last_sample_time = soft_timer_now() - trace.arm.period;
+  }
+
+  if (soft_timer_now() - trace.last_sample_time < trace.arm.period) {
+    return;
+  }
+
+  record = &trace.records[trace.head];
+  record->position = blender->position;
+  record->velocity = blender->velocity;
+  record->duty = blender->duty;
+  record->direction = blender->drive_direction;
+  record->step = step;
+  record->delta_time = (soft_timer_now() - trace.last_sample_time > 0xFF) ? 0xFF : soft_timer_now() - trace.last_sample_time;
+  trace.last_sample_time = soft_timer_now();
+
+  if (++trace.head >= TRACE_RECORDS) {
+    trace.head = 0;
+  }
+  trace.count++;
+
+  if ((!triggered && ++trace.post_records >= TRACE_POST_RECORDS) || trace.count >= TRACE_RECORDS) {
+    trace.state = TRACE_COMPLETE;
+    sprintf_P(status, PSTR("Trace complete: %d records"), trace.count);
+    send_status(status);
+  }
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  trace_dump                               <trace.c>
+
+  SYNTAX: void trace_dump( void );
+
+  DESCRIPTION:
+  Sends the captured records over USB, oldest first,
+  TRACE_RECORDS_PER_CHUNK per message. A capture
+  still running is dumped as far as it got.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void trace_dump() {
+  hmi_message_t msg;
+  trace_chunk_t* chunk = (trace_chunk_t*)msg.payload;
+  unsigned char index = (trace.head + TRACE_RECORDS - trace.count) % TRACE_RECORDS;
+  unsigned char sent = 0;
+  unsigned char i;
+
+  msg.message_id = MSG_TRACE_DUMP;
+  chunk->chunk = 0;
+  chunk->chunks = (trace.count + TRACE_RECORDS_PER_CHUNK - 1) / TRACE_RECORDS_PER_CHUNK;
+  chunk->period = trace.arm.period;
+
+  do {
+    chunk->count = 0;
+    for (i = 0; i < TRACE_RECORDS_PER_CHUNK && sent < trace.count; i++, sent++) {
+      chunk->records[i] = trace.records[index];
+      chunk->count++;
+      if (++index >= TRACE_RECORDS) {
+        index = 0;
+      }
+    }
+    c_send_message(msg, sizeof(trace_chunk_t) - sizeof(trace_record_t) * (TRACE_RECORDS_PER_CHUNK - chunk->count));
+    chunk->chunk++;
+  } while (sent < trace.count);
+}
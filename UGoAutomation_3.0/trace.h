@@ -0,0 +1,56 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "global.h"
+#include "blender.h"
+
+// 8 bytes each, the default 768 bytes is the biggest single user of the
+// 8 KB of RAM after the action arrays. Build with a smaller
+// -DTRACE_RECORDS if the RAM report shows the stack getting close
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS 96
+#endif
+#if TRACE_RECORDS < 1 || TRACE_RECORDS > 255
+#error "TRACE_RECORDS is counted in an unsigned char"
+#endif
+#define TRACE_POST_RECORDS 16 // kept after the traced step ends, to see the stop
+// ms, 50 Hz, the ring then covers about 1.9 s, a typical move. Arm with
+// a shorter period to look at the ramp in detail
+#define TRACE_DEFAULT_PERIOD 20
+#define TRACE_RECORDS_PER_CHUNK 24
+
+#define TRACE_ARM_OFF 0
+#define TRACE_ARM_STEP 1 // value is a blend step index
+#define TRACE_ARM_STATE 2 // value is a machine state
+
+typedef struct __attribute__((__packed__, aligned(1))) {
+  int position;
+  int velocity;
+  unsigned char duty;
+  char direction;
+  unsigned char step;
+  /* ms since the record before, shows any gaps in the rate */
+  unsigned char delta_time;
+} trace_record_t;
+
+typedef struct __attribute__((__packed__, aligned(1))) {
+  char mode;
+  /* blend step index or machine state */
+  unsigned char value;
+  /* ms between records, 0 for TRACE_DEFAULT_PERIOD */
+  unsigned char period;
+} trace_arm_t;
+
+typedef struct __attribute__((__packed__, aligned(1))) {
+  unsigned char chunk;
+  unsigned char chunks;
+  unsigned char count;
+  unsigned char period;
+  trace_record_t records[TRACE_RECORDS_PER_CHUNK];
+} trace_chunk_t;
+
+char trace_arm(trace_arm_t*);
+void trace_sample(blender_t*, char, unsigned char);
+void trace_dump();
+
+#endif
@@ -0,0 +1,254 @@
+/***************************************************
+  UART                                      <uart.c>
+
+  Interrupt driven driver for UART0, the USB link to
+  the HMI, in place of the core's Serial.
+
+  The receive interrupt does the framing. Bytes are
+  thrown away until a start of frame, then the frame
+  is written into the ring past the point the main
+  loop can see, and only made visible once the
+  length from its header has arrived. So the main
+  loop only ever reads whole frames, and when the
+  ring is full the frame being received is dropped
+  and counted rather than corrupting the next one.
+
+  The ring has one writer, the interrupt, and one
+  reader, the main loop, and single byte indexes, so
+  neither side needs to turn interrupts off.
+
+  Sending is buffered too, the transmit interrupt
+  empties the ring. uart_write only waits when the
+  ring is full.
+***************************************************/
+#include "uart.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#define UART_RX_MASK (UART_RX_SIZE - 1)
+#define UART_TX_MASK (UART_TX_SIZE - 1)
+
+#define UART_HUNT 0 // waiting for the first byte of a start of frame
+#define UART_START 1 // had the first byte
+#define UART_FRAME 2 // in a frame
+
+static unsigned char uart_rx_ring[UART_RX_SIZE];
+// head is the end of the last whole frame, frame_head where the frame
+// being received has got to
+static volatile unsigned char uart_rx_head;
+static volatile unsigned char uart_rx_tail;
+static unsigned char uart_rx_frame_head;
+static unsigned char uart_rx_state;
+static unsigned int uart_rx_count;
+static unsigned int uart_rx_length;
+
+static unsigned char uart_tx_ring[UART_TX_SIZE];
+static volatile unsigned char uart_tx_head;
+static volatile unsigned char uart_tx_tail;
+
+static volatile uart_stats_t uart_stats;
+
+// keeps a byte of the frame, 0 if the ring is full
+static char uart_rx_put(unsigned char data) {
+  unsigned char next = (uart_rx_frame_head + 1) & UART_RX_MASK;
+
+  if (next == uart_rx_tail) {
+    return 0;
+  }
+  uart_rx_ring[uart_rx_frame_head] = data;
+  uart_rx_frame_head = next;
+  return 1;
+}
+
+ISR(USART0_RX_vect) {
+  unsigned char status = UCSR0A;
+  unsigned char data = UDR0;
+  unsigned char used;
+
+  if (status & (_BV(FE0) | _BV(DOR0))) {
+    uart_stats.rx_errors++;
+  }
+
+  switch (uart_rx_state) {
+    case UART_HUNT:
+      if (data == (START_OF_MESSAGE & 0xFF)) {
+        uart_rx_state = UART_START;
+      } else {
+        uart_stats.rx_discarded++;
+      }
+      return;
+    case UART_START:
+      if (data != (START_OF_MESSAGE >> 8)) {
+        uart_stats.rx_discarded++;
+        if (data != (START_OF_MESSAGE & 0xFF)) {
+          uart_stats.rx_discarded++;
+          uart_rx_state = UART_HUNT;
+        }
+        return;
+      }
+      uart_rx_frame_head = uart_rx_head;
+      uart_rx_count = 2;
+      uart_rx_state = UART_FRAME;
+      if (uart_rx_put(START_OF_MESSAGE & 0xFF) && uart_rx_put(START_OF_MESSAGE >> 8)) {
+        return;
+      }
+      break;
+    case UART_FRAME:
+      if (!uart_rx_put(data)) {
+        break;
+      }
+      uart_rx_count++;
+      if (uart_rx_count == 3) {
+        uart_rx_length = data;
+        return;
+      }
+      if (uart_rx_count == 4) {
+        uart_rx_length |= (unsigned int)data << 8;
+        if (uart_rx_length < UART_FRAME_MIN || uart_rx_length > UART_RX_MASK) {
+          uart_stats.rx_discarded += 4;
+          uart_rx_state = UART_HUNT;
+        }
+        return;
+      }
+      if (uart_rx_count == uart_rx_length) {
+        // the whole frame is in, let the main loop have it
+        uart_rx_head = uart_rx_frame_head;
+        uart_rx_state = UART_HUNT;
+        uart_stats.rx_frames++;
+        used = (uart_rx_head - uart_rx_tail) & UART_RX_MASK;
+        if (used > uart_stats.rx_peak) {
+          uart_stats.rx_peak = used;
+        }
+      }
+      return;
+  }
+
+  // no room for the rest of the frame
+  uart_stats.rx_overflows++;
+  uart_rx_state = UART_HUNT;
+}
+
+ISR(USART0_UDRE_vect) {
+  if (uart_tx_head == uart_tx_tail) {
+    UCSR0B &= ~_BV(UDRIE0);
+    return;
+  }
+  UDR0 = uart_tx_ring[uart_tx_tail];
+  uart_tx_tail = (uart_tx_tail + 1) & UART_TX_MASK;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  uart_init                                 <uart.c>
+
+  SYNTAX: void uart_init( unsigned long baud );
+
+  DESCRIPTION:
+  Sets up UART0 for 8N1 at a baud rate, with double
+  speed like the core uses for 115200.
+
+  PARAMETER1: The baud rate
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void uart_init(unsigned long baud) {
+  uart_rx_head = 0;
+  uart_rx_tail = 0;
+  uart_rx_state = UART_HUNT;
+  uart_tx_head = 0;
+  uart_tx_tail = 0;
+  memset((void*)&uart_stats, 0, sizeof(uart_stats));
+
+  UCSR0A = _BV(U2X0);
+  UBRR0 = (F_CPU / 4 / baud - 1) / 2;
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+  UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  uart_available                            <uart.c>
+
+  SYNTAX: unsigned char uart_available( void );
+
+  DESCRIPTION:
+  Bytes of whole frames waiting to be read.
+
+  RETURN VALUE:  the number of bytes
+  END DESCRIPTION ***********************************/
+unsigned char uart_available() {
+  return (uart_rx_head - uart_rx_tail) & UART_RX_MASK;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  uart_read                                 <uart.c>
+
+  SYNTAX: unsigned char uart_read( void );
+
+  DESCRIPTION:
+  Takes the next received byte, check uart_available
+  first.
+
+  RETURN VALUE:  the byte, 0 if there is none
+  END DESCRIPTION ***********************************/
+unsigned char uart_read() {
+  unsigned char data;
+
+  if (uart_rx_head == uart_rx_tail) {
+    return 0;
+  }
+  data = uart_rx_ring[uart_rx_tail];
+  uart_rx_tail = (uart_rx_tail + 1) & UART_RX_MASK;
+  return data;
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  uart_write                                <uart.c>
+
+  SYNTAX: void uart_write( const unsigned char* data, unsigned int len );
+
+  DESCRIPTION:
+  Queues bytes to send, waiting for room when the
+  ring is full.
+
+  PARAMETER1: The bytes
+  PARAMETER2: How many
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void uart_write(const unsigned char* data, unsigned int len) {
+  unsigned char next;
+
+  while (len--) {
+    next = (uart_tx_head + 1) & UART_TX_MASK;
+    while (next == uart_tx_tail) {
+      // with interrupts off nothing would empty the ring, send by hand
+      if (!(SREG & _BV(SREG_I)) && (UCSR0A & _BV(UDRE0))) {
+        UDR0 = uart_tx_ring[uart_tx_tail];
+        uart_tx_tail = (uart_tx_tail + 1) & UART_TX_MASK;
+      }
+    }
+    uart_tx_ring[uart_tx_head] = *data++;
+    uart_tx_head = next;
+    UCSR0B |= _BV(UDRIE0);
+  }
+}
+
+/* START FUNCTION DESCRIPTION *********************
+  uart_report                               <uart.c>
+
+  SYNTAX: void uart_report( void );
+
+  DESCRIPTION:
+  Sends a MSG_UART_STATS with the receive counters.
+
+  RETURN VALUE:  null
+  END DESCRIPTION ***********************************/
+void uart_report() {
+  hmi_message_t msg;
+
+  msg.message_id = MSG_UART_STATS;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    memcpy(msg.payload, (void*)&uart_stats, sizeof(uart_stats_t));
+  }
+  c_send_message(msg, sizeof(uart_stats_t));
+}
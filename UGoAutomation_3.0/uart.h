@@ -0,0 +1,32 @@
+#ifndef UART_H
+#define UART_H
+
+#include "global.h"
+
+// sizes must be powers of 2 up to 256, the receive side holds a whole frame
+#define UART_RX_SIZE 256
+#define UART_TX_SIZE 256
+
+// a frame is the header, payload, CRC and end of frame
+#define UART_FRAME_MIN 12
+
+typedef struct __attribute__((__packed__, aligned(1))) {
+  /* whole frames received */
+  unsigned long rx_frames;
+  /* frames dropped because the ring was full */
+  unsigned int rx_overflows;
+  /* bytes outside any frame, or frames with a bad length */
+  unsigned int rx_discarded;
+  /* bytes lost in the UART itself, framing errors and data overruns */
+  unsigned int rx_errors;
+  /* most bytes ever waiting in the ring */
+  unsigned char rx_peak;
+} uart_stats_t;
+
+void uart_init(unsigned long);
+unsigned char uart_available();
+unsigned char uart_read();
+void uart_write(const unsigned char*, unsigned int);
+void uart_report();
+
+#endif
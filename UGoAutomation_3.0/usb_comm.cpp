@@ -8,7 +8,11 @@
 * SM070716
 ***************************************************/
 #include "usb_comm.h"
-#include <HardwareSerial.h>
+
+extern "C" {
+  #include "uart.h"
+  #include "trace.h"
+}
 
 /* Buffer to store read bytes from a frame */
 char hmi_in_buffer[255];
@@ -16,8 +20,8 @@ char hmi_in_buffer[255];
 /* Keep track of how many bytes for a message read already */
 char current_bytes_read = 0;
 
-/* Standard CRC16 tables */
-static const unsigned short crc_table[256] = {
+/* Standard CRC16 tables, in flash */
+static const unsigned short crc_table[256] PROGMEM = {
   0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
   0x8c48, 0x9dc1, 0xaf5a, 0xbed3, 0xca6c, 0xdbe5, 0xe97e, 0xf8f7,
   0x1081, 0x0108, 0x3393, 0x221a, 0x56a5, 0x472c, 0x75b7, 0x643e,
@@ -122,8 +126,8 @@ SM070716
 END DESCRIPTION ***********************************/
 int usb_communication_process() {
   // read the incoming serial data  
-  while (Serial.available() && current_bytes_read < sizeof(hmi_in_buffer)) {
-    hmi_in_buffer[current_bytes_read++] = Serial.read();
+  while (uart_available() && current_bytes_read < sizeof(hmi_in_buffer)) {
+    hmi_in_buffer[current_bytes_read++] = uart_read();
     if (current_bytes_read > 1) {
       // check for end of frame message, if we have and end of frame leave the
       // next message in the buffer.
@@ -227,8 +231,8 @@ void usb_communication_send_message(hmi_message_t msgToSend, unsigned int len) {
   hmi_out_buffer[i++] = 0x7F; // EOF
   hmi_out_buffer[i++] = 0x55; // EOF
 
-  Serial.write(hmi_out_buffer, i);
-  Serial.write("\n");
+  uart_write(hmi_out_buffer, i);
+  uart_write((const unsigned char*)"\n", 1);
 }
 
 void usb_communication_parse_message(short message_id, char* buffer){
@@ -251,7 +255,7 @@ void usb_communication_parse_message(short message_id, char* buffer){
       mediator_send_message(MEDIATOR_STOP_REQUEST, (char*)"");
       break;
     case MSG_TOGGLE_ACTUATOR_STATE:
-      digitalWrite(buffer[8], !digitalRead(buffer[8]));
+      mediator_send_message(MEDIATOR_TOGGLE_OUTPUT, &buffer[8]);
       break;
 
     case MSG_REBLEND:
@@ -276,6 +280,41 @@ void usb_communication_parse_message(short message_id, char* buffer){
     case MSG_DISABLE_KEYPAD:
           mediator_send_message(MEDIATOR_DISABLE_KEYPAD, (char*)"");
     break;
+    case MSG_CALIBRATE_SPEED:
+          mediator_send_message(MEDIATOR_CALIBRATE_SPEED, (char*)"");
+    break;
+    case MSG_TRACE_ARM:
+          // the frame length covers the 12 bytes of header, crc and eof
+          if ((unsigned int)((unsigned char)buffer[2] | ((unsigned char)buffer[3] << 8)) < 12 + sizeof(trace_arm_t)) {
+            send_status_P(PSTR("Trace arm message too short"));
+            break;
+          }
+          mediator_send_message(MEDIATOR_TRACE_ARM, &buffer[8]);
+    break;
+    case MSG_TRACE_DUMP:
+          mediator_send_message(MEDIATOR_TRACE_DUMP, (char*)"");
+    break;
+    case MSG_SCHEDULER_REPORT:
+          mediator_send_message(MEDIATOR_SCHEDULER_REPORT, (char*)"");
+    break;
+    case MSG_PROFILE_REPORT:
+          mediator_send_message(MEDIATOR_PROFILE_REPORT, (char*)"");
+    break;
+    case MSG_PROFILE_RESET:
+          mediator_send_message(MEDIATOR_PROFILE_RESET, (char*)"");
+    break;
+    case MSG_GET_ACTUATOR_STATE:
+          mediator_send_message(MEDIATOR_GET_OUTPUTS, (char*)"");
+    break;
+    case MSG_POWER_REPORT:
+          mediator_send_message(MEDIATOR_POWER_REPORT, (char*)"");
+    break;
+    case MSG_MEMORY_REPORT:
+          mediator_send_message(MEDIATOR_MEMORY_REPORT, (char*)"");
+    break;
+    case MSG_UART_STATS:
+          mediator_send_message(MEDIATOR_UART_STATS, (char*)"");
+    break;
     default:
       // NOT IMPLEMENTED YET!
     break;
@@ -294,3 +333,13 @@ void send_status(char* message){
     memcpy(&msg.status_message.message, message, strlen(message));
     usb_communication_send_message(msg, strlen(message));
 }
+
+// same as send_status for a message in flash, send_status_P(PSTR("..."))
+void send_status_P(PGM_P message){
+    hmi_message_t msg;
+    unsigned int len = strlen_P(message);
+    msg.message_id = MSG_STATUS;
+    memset(&msg.status_message.message, 0, sizeof(msg.status_message.message));
+    memcpy_P(&msg.status_message.message, message, len);
+    usb_communication_send_message(msg, len);
+}
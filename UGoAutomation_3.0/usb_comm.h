@@ -23,11 +23,21 @@
 #define MAX_HMI_PAYLOAD_SIZE      200
 #define MSG_STATUS                0x000D
 #define MSG_DISABLE_KEYPAD        0x000E
+#define MSG_CALIBRATE_SPEED       0x000F
+#define MSG_TRACE_ARM             0x0010
+#define MSG_TRACE_DUMP            0x0011
+#define MSG_SCHEDULER_REPORT      0x0012
+#define MSG_PROFILE_REPORT        0x0013
+#define MSG_PROFILE_RESET         0x0014
+#define MSG_POWER_REPORT          0x0015
+#define MSG_MEMORY_REPORT         0x0016
+#define MSG_UART_STATS            0x0017
+#define MSG_LOG_BINARY            0x0018
 
 /* CRC calculation macros */
 #define CRC_INIT 0xFFFF
 #define CRC(crcval,newchar) crcval = (crcval >> 8) ^ \
-                                     crc_table[(crcval ^ newchar) & 0x00ff]
+                                     pgm_read_word(&crc_table[(crcval ^ newchar) & 0x00ff])
 
 typedef struct __attribute__((__packed__, aligned(1))) {
     char level;
@@ -74,6 +84,7 @@ extern "C" {
 #endif
 void c_send_message(hmi_message_t msg, unsigned int size);
 void send_status(char*);
+void send_status_P(PGM_P);
 #ifdef __cplusplus 
 }
 #endif
@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+"""
+Renders the binary logs the controller sends as text.
+
+Reads HMI frames from a capture file or a serial port, picks out the
+MSG_LOG_BINARY messages and formats every record in them with the table
+log_sites.py built from the same source as the firmware. Every other
+message is skipped.
+
+  tools/log_decode.py log_sites.json capture.bin
+  tools/log_decode.py log_sites.json /dev/ttyACM0 --baud 115200
+
+A record is [length][level][file id][line, 2 bytes][ms, 4 bytes][args],
+the arguments raw in the order of the format: 2 bytes for %d/%u/%x/%c,
+4 bytes for %ld/%lu/%lx and a 0 terminated string for %s. Everything is
+little endian. A record with LOG_REPEATED set in the level is the count
+of records its site held back, 2 bytes.
+"""
+
+import argparse
+import json
+import re
+import struct
+import sys
+
+START_OF_MESSAGE = b'\x7e\x55'
+END_OF_MESSAGE = b'\x7f\x55'
+MSG_LOG_BINARY = 0x0018
+# header is sof, len, src, dest and id, the trailer crc and eof
+FRAME_HEADER = 8
+FRAME_TRAILER = 4
+RECORD_HEADER = 9
+LOG_REPEATED = 0x80
+
+LEVELS = {1: 'ASSERT', 2: 'DEBUG', 4: 'ERROR', 8: 'INFO', 16: 'VERBOSE', 32: 'WARNING'}
+SPEC = re.compile(r'%(l?)([sduxc%])')
+
+
+def crc16(data):
+    """CRC16 of usb_comm.cpp, reflected 0x8408 from 0xFFFF."""
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+    return crc
+
+
+def frames(stream):
+    """Yields (message id, payload) of every good frame in the stream."""
+    buffer = b''
+    while True:
+        # a serial port only blocks for what it has been asked for
+        chunk = stream.read(max(1, getattr(stream, 'in_waiting', 256)))
+        if not chunk:
+            return
+        buffer += chunk
+        while True:
+            start = buffer.find(START_OF_MESSAGE)
+            if start < 0:
+                buffer = buffer[-1:]
+                break
+            buffer = buffer[start:]
+            if len(buffer) < 4:
+                break
+            length = struct.unpack_from('<H', buffer, 2)[0]
+            if length < FRAME_HEADER + FRAME_TRAILER:
+                buffer = buffer[2:]
+                continue
+            if len(buffer) < length:
+                break
+            frame = buffer[:length]
+            crc = struct.unpack_from('<H', frame, length - 4)[0]
+            if frame[-2:] != END_OF_MESSAGE or crc16(frame[:length - 4]) != crc:
+                buffer = buffer[2:]
+                continue
+            buffer = buffer[length:]
+            message_id = struct.unpack_from('<H', frame, 6)[0]
+            yield message_id, frame[FRAME_HEADER:length - FRAME_TRAILER]
+
+
+def render(fmt, args):
+    """Formats the raw arguments like the controller's old log_print."""
+    out = []
+    offset = 0
+    last = 0
+    for spec in SPEC.finditer(fmt):
+        out.append(fmt[last:spec.start()])
+        last = spec.end()
+        is_long, kind = spec.group(1), spec.group(2)
+        if kind == '%':
+            out.append('%')
+            continue
+        if kind == 's':
+            end = args.find(b'\0', offset)
+            if end < 0:
+                out.append('<truncated>')
+                break
+            out.append(args[offset:end].decode('latin-1'))
+            offset = end + 1
+            continue
+        size = 4 if is_long else 2
+        if offset + size > len(args):
+            out.append('<truncated>')
+            break
+        signed = kind == 'd'
+        value = int.from_bytes(args[offset:offset + size], 'little', signed=signed)
+        offset += size
+        if kind == 'x':
+            out.append('%x' % value)
+        elif kind == 'c':
+            out.append(chr(value & 0xFF))
+        else:
+            out.append(str(value))
+    else:
+        out.append(fmt[last:])
+    return ''.join(out)
+
+
+def records(table, payload):
+    """Yields the text of every record in a MSG_LOG_BINARY payload."""
+    dropped = struct.unpack_from('<H', payload, 0)[0]
+    if dropped:
+        yield '%d records dropped' % dropped
+    offset = 2
+    while offset + RECORD_HEADER <= len(payload):
+        length, level, file_id, line, ms = struct.unpack_from('<BBBHI', payload, offset)
+        if length < RECORD_HEADER:
+            yield 'bad record length %d' % length
+            return
+        args = payload[offset + RECORD_HEADER:offset + length]
+        offset += length
+
+        entry = table.get(str(file_id))
+        name = entry['file'] if entry else 'file %d' % file_id
+        fmt = entry['sites'].get(str(line)) if entry else None
+        if level & LOG_REPEATED and len(args) == 2:
+            level &= ~LOG_REPEATED
+            text = '... %d more held back' % struct.unpack('<H', args)[0]
+        elif fmt is None:
+            text = 'unknown site, args %s' % args.hex()
+        else:
+            text = render(fmt, args)
+        yield '%10d %-7s %s:%d %s' % (ms, LEVELS.get(level, level), name, line, text)
+
+
+def open_input(path, baud):
+    try:
+        import serial
+    except ImportError:
+        return open(path, 'rb')
+    if path.startswith('/dev/') or path.upper().startswith('COM'):
+        return serial.Serial(path, baud, timeout=None)
+    return open(path, 'rb')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode MSG_LOG_BINARY records')
+    parser.add_argument('sites', help='JSON table from log_sites.py')
+    parser.add_argument('input', help='capture file or serial port')
+    parser.add_argument('--baud', type=int, default=115200)
+    args = parser.parse_args()
+
+    with open(args.sites) as f:
+        table = json.load(f)
+
+    stream = open_input(args.input, args.baud)
+    for message_id, payload in frames(stream):
+        if message_id != MSG_LOG_BINARY or len(payload) < 2:
+            continue
+        for text in records(table, payload):
+            print(text)
+            sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    main()
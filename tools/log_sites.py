@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""
+Builds the log site table for log_decode.py.
+
+The controller only records the file id, line, level and raw arguments of
+a LOG_PRINT, the format strings stay in the source. This scans the sketch
+for the LOG_FILE_ID of every file and the format of every LOG_PRINT and
+writes them out as JSON, LOG_PRINT_INTERVAL included:
+
+  { "<file id>": { "file": "machine.c", "sites": { "<line>": "<format>" } } }
+
+A call that spans several lines is listed under each of them, the
+compiler reports __LINE__ of a macro call differently between versions.
+
+Run it against the same source the firmware was built from:
+
+  tools/log_sites.py UGoAutomation_3.0 -o log_sites.json
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+SOURCE_EXTENSIONS = ('.c', '.cpp', '.ino')
+FILE_ID = re.compile(r'^\s*#define\s+LOG_FILE_ID\s+(\d+)', re.M)
+CALL = re.compile(r'\bLOG_PRINT(?:_INTERVAL)?\s*\(')
+STRING = re.compile(r'"((?:[^"\\]|\\.)*)"')
+
+
+def call_end(text, start):
+    """Index just past the closing paren of the call opened at start."""
+    depth = 0
+    i = start
+    while i < len(text):
+        c = text[i]
+        if c == '"':
+            literal = STRING.match(text, i)
+            i = literal.end() if literal else i + 1
+            continue
+        if c == '(':
+            depth += 1
+        elif c == ')':
+            depth -= 1
+            if depth == 0:
+                return i + 1
+        i += 1
+    return len(text)
+
+
+def unescape(literal):
+    return literal.encode('latin-1').decode('unicode_escape')
+
+
+def scan(path):
+    with open(path, encoding='latin-1') as f:
+        text = f.read()
+
+    match = FILE_ID.search(text)
+    if not match:
+        return None, {}
+
+    sites = {}
+    for call in CALL.finditer(text):
+        # the define of the macro itself has no literal format
+        line_start = text.rfind('\n', 0, call.start()) + 1
+        if text[line_start:call.start()].lstrip().startswith('#'):
+            continue
+        end = call_end(text, call.end() - 1)
+        args = text[call.end():end]
+        # adjacent literals are one format
+        literals = []
+        for literal in STRING.finditer(args):
+            if literals and args[literals[-1].end():literal.start()].strip():
+                break
+            literals.append(literal)
+        if not literals:
+            continue
+        fmt = ''.join(unescape(l.group(1)) for l in literals)
+        first = text.count('\n', 0, call.start()) + 1
+        last = text.count('\n', 0, end) + 1
+        for line in range(first, last + 1):
+            sites[str(line)] = fmt
+    return int(match.group(1)), sites
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Extract the LOG_PRINT format table')
+    parser.add_argument('source', help='sketch directory')
+    parser.add_argument('-o', '--output', help='JSON file, stdout if not given')
+    args = parser.parse_args()
+
+    table = {}
+    for name in sorted(os.listdir(args.source)):
+        if not name.endswith(SOURCE_EXTENSIONS):
+            continue
+        file_id, sites = scan(os.path.join(args.source, name))
+        if file_id is None:
+            continue
+        if str(file_id) in table:
+            sys.exit('LOG_FILE_ID %d used by %s and %s'
+                     % (file_id, table[str(file_id)]['file'], name))
+        table[str(file_id)] = {'file': name, 'sites': sites}
+
+    out = open(args.output, 'w') if args.output else sys.stdout
+    json.dump(table, out, indent=2, sort_keys=True)
+    out.write('\n')
+
+
+if __name__ == '__main__':
+    main()